@@ -25,7 +25,18 @@
 #include <poll.h>
 #include <unistd.h>
 #include <memory>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <climits>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include "trace.hpp"
 using namespace std;
 
 /* 
@@ -62,7 +73,9 @@ typedef enum
     /// In this mode, the pins will be accessed directly through registers. If you don't know what that means, please stay away from using this! This mode will give you ~19 MHz of maximum output toggling frequency.
     GPIO_MODE_DIRECT,
     /// In this mode, the pins will be accessed through the OS' "sysfs" interface. This is the default mode, since it's a lot safer than the other method. This mode will give you ~8 kHz of maximum output toggling frequency.
-    GPIO_MODE_SYSFS
+    GPIO_MODE_SYSFS,
+    /// In this mode, no hardware is touched at all. Pin levels are fed in either from the same process through inject() or by writing '0'/'1' characters to a FIFO at "<directory>/gpio<n>/value" (see setDirectory). This is meant for running the program off a Pi, e.g. in CI or stress tests.
+    GPIO_MODE_SIMULATED
 } GPIOMode;
 
 /// Defines whether the pin should be configured for input or output.
@@ -82,7 +95,9 @@ typedef enum
     /// Falling edge
     GPIO_EDGE_FALLING,
     /// Rising edge
-    GPIO_EDGE_RISING
+    GPIO_EDGE_RISING,
+    /// No edge after all (see readEdge)
+    GPIO_EDGE_NONE
 } GPIOEdge;
 
 inline long filesize(FILE *_file)
@@ -94,20 +109,30 @@ inline long filesize(FILE *_file)
     return fSize;
 }
 
+template <int32_t Pin, GPIODirection Direction>
+class StaticGPIO;
+
 /// This class provides a simplified interface for accessing the GPIO pins on the Raspberry Pi.
 class GPIO
 {
+    template <int32_t Pin, GPIODirection Direction>
+    friend class StaticGPIO;
+
 public:
-    /// This function opens a connection to a specific pin on your Pi, creating a new instance of the GPIO class. If you wish to access multiple pins, you will have to instantiate the GPIO class multiple times. Each instance is responsible for controlling one pin only.
+    /// This function opens a connection to a specific pin on your Pi. If you wish to access multiple pins, you will have to open each of them. Each instance is responsible for controlling one pin only, and there is only one instance per pin in the process: opening a pin that is already open hands out the same instance again, which is exported once and unexported when the last shared_ptr to it is gone.
     /// @param n The number of the GPIO pin you wish to access (see http://elinux.org/File:GPIOs.png )
-    /// @param direction This defines the direction of the pin (input or output)
-    /// @return A shared_ptr to a newly created instance of the GPIO class. This object will let you access the GPIO pin you requested.
+    /// @param direction This defines the direction of the pin (input or output). Opening an open pin with another direction changes it for every user of the pin.
+    /// @return A shared_ptr to the instance of the GPIO class for the pin. This object will let you access the GPIO pin you requested.
     static shared_ptr<GPIO> openGPIO(int32_t n, GPIODirection direction);
 
     /// This function changes how the GPIO pins are accessed. Please DON'T change around the access mode unless you have a good reason to do so! Notice that this is a static function, so you only want to call it once, and the change will apply for all the GPIO connections. IMPORTANT: it's only safe call this function BEFORE creating any instances of the class!
     /// @param mode The access method you wish to use
     static void setMode(GPIOMode mode);
 
+    /// This function changes the directory the pins are looked up in (the default is "/sys/class/gpio/"). In GPIO_MODE_SIMULATED a FIFO found at "<directory>/gpio<n>/value" is used as the source of edges for pin n. Just like setMode, only call this BEFORE creating any instances of the class!
+    /// @param directory The directory to use, with a trailing slash
+    static void setDirectory(string directory);
+
     /// This sets the direction of a GPIO pin. Unless you need to change a pin's direction on the fly, you don't need to call this function, since every pin is initially given a direction of your choice, once you request access to it.
     /// @see openGPIO
     /// @param direction This defines the direction of the pin (input or output)
@@ -136,9 +161,38 @@ public:
     /// @return The kind of edge that was detected.
     inline GPIOEdge waitForAnyEdge(int32_t timeout = -1);
 
+    /// This function will not return until any kind of edge is detected on any of the given pins. Unlike the other waiting functions, edge detection stays enabled between calls, so no edge is lost while the caller is busy.
+    /// @param pins The pins to wait on.
+    /// @param edge Set to the kind of edge that was detected.
+    /// @param timeout (optional) Timeout in milliseconds.
+    /// @param wakeFd (optional) Another fd to wait on in the same poll, e.g. a signalfd. The function also returns when it becomes readable.
+    /// @return The pin the edge was detected on, or nullptr if the timeout ran out or wakeFd became readable. Throws if poll() fails.
+    static shared_ptr<GPIO> waitForAnyEdge(const vector<shared_ptr<GPIO>> &pins, GPIOEdge &edge, int32_t timeout = -1, int32_t wakeFd = -1);
+
+    /// Returns a file descriptor that becomes ready (for the events given by getEdgeEvents) when an edge is detected on the pin, for waiting on several pins or other files with poll(). Edge detection stays enabled until the GPIO is destroyed.
+    int32_t getEdgeFd();
+
+    /// Returns the poll() events to wait for on getEdgeFd().
+    short getEdgeEvents();
+
+    /// Reads the edge that made getEdgeFd() ready.
+    /// @return The kind of edge, or GPIO_EDGE_NONE if there was nothing to read after all.
+    GPIOEdge readEdge();
+
     /// Returns the number of the GPIO pin (the same number you provided in the first argument of openGPIO)
     int32_t getNumber();
 
+    /// Reads the levels of the pins 0-31 at once from the GPLEV0 register, without opening them. Only usable in GPIO_MODE_DIRECT.
+    /// @return Bit n is the level of pin n
+    static uint32_t readLevels();
+
+    /// Sets the level of a simulated pin, producing an edge for whoever is waiting on it. read() reports the new level once that edge has been read. Only usable in GPIO_MODE_SIMULATED, and safe to call from any thread.
+    /// @param value The new level of the pin.
+    void inject(bool value);
+
+    /// Returns a file descriptor that '0'/'1' characters can be written to in order to drive a simulated pin, e.g. from another thread without going through inject(). Only usable in GPIO_MODE_SIMULATED.
+    int32_t getInjectFd();
+
     /// Don't use these manually
     ~GPIO();
     GPIO(int32_t n);
@@ -146,7 +200,9 @@ public:
 private:
     void _export();
     void _unexport();
+    FILE *openWhenReady(const string &path, const char *mode);
     inline void dEdgeInterruption(string getedg_str);
+    inline char simConsume(int32_t timeout);
     static void setup_io();
 
     static string GPIODirectory;
@@ -154,6 +210,10 @@ private:
     static void *gpio_map;
     static volatile unsigned *gpio;
     static GPIOMode accessMode;
+    // Every open pin, held weakly so the last user closing it unexports it. An expired entry is a pin still being unexported, registryClosed is notified once it is gone.
+    static mutex registryLock;
+    static condition_variable registryClosed;
+    static map<int32_t, weak_ptr<GPIO>> registry;
     string GPIONumberString;
     int32_t GPIONumber;
     static chrono::milliseconds timeOut;
@@ -165,6 +225,66 @@ private:
     string getedg_str;
     string getval_str;
     string setdir_str;
+
+    int32_t edge_fd = -1;
+    int32_t sim_rd = -1;
+    int32_t sim_wr = -1;
+    atomic<bool> simLevel{false};
+};
+
+/// A pin known at compile time, accessed directly through the registers. The register word and bit mask are constants, so read() compiles to a single volatile load and write() to a single volatile store, with no access mode to check. Meant for fast status outputs and sampling next to the sensor loop. Only works in GPIO_MODE_DIRECT, and only for the pins 0-31 (the first bank of each register).
+/// @tparam Pin The number of the GPIO pin (see http://elinux.org/File:GPIOs.png )
+/// @tparam Direction The direction the pin is set to on construction
+template <int32_t Pin, GPIODirection Direction>
+class StaticGPIO
+{
+    static_assert(Pin >= 0 && Pin < 32, "StaticGPIO only supports the pins 0-31");
+
+public:
+    /// Word offsets of the registers from the GPIO base
+    static constexpr uint32_t GPSET0 = 7, GPCLR0 = 10, GPLEV0 = 13;
+    /// The pin's bit in GPSET0, GPCLR0 and GPLEV0
+    static constexpr uint32_t mask = 1u << Pin;
+
+    /// Sets the pin's direction. GPIO::setMode(GPIO_MODE_DIRECT) has to be called first.
+    StaticGPIO() : registers(GPIO::gpio)
+    {
+        if (!registers)
+            throw std::runtime_error("OPERATION FAILED: Unable to access GPIO"s + to_string(Pin) +
+                                     " (the registers are not mapped, use GPIO_MODE_DIRECT).");
+        // Three function select bits per pin, ten pins per word
+        volatile unsigned &select = registers[Pin / 10];
+        select = (select & ~(7u << (Pin % 10 * 3))) | ((Direction == GPIO_INPUT ? 0u : 1u) << (Pin % 10 * 3));
+        if (Direction != GPIO_INPUT)
+            registers[Direction == GPIO_OUTPUT_INIT_HIGH ? GPSET0 : GPCLR0] = mask;
+    }
+
+    /// @return The level of the pin
+    bool read() const { return registers[GPLEV0] & mask; }
+
+    /// Drives the pin high or low
+    void write(bool value)
+    {
+        static_assert(Direction != GPIO_INPUT, "The pin is an input");
+        registers[value ? GPSET0 : GPCLR0] = mask;
+    }
+
+    /// Drives the pin high
+    void set()
+    {
+        static_assert(Direction != GPIO_INPUT, "The pin is an input");
+        registers[GPSET0] = mask;
+    }
+
+    /// Drives the pin low
+    void clear()
+    {
+        static_assert(Direction != GPIO_INPUT, "The pin is an input");
+        registers[GPCLR0] = mask;
+    }
+
+private:
+    volatile unsigned *registers;
 };
 
 int32_t GPIO::mem_fd = 0;
@@ -173,6 +293,9 @@ volatile unsigned *GPIO::gpio = nullptr;
 GPIOMode GPIO::accessMode = GPIO_MODE_SYSFS;
 string GPIO::GPIODirectory = "/sys/class/gpio/";
 chrono::milliseconds GPIO::timeOut = 1000ms;
+mutex GPIO::registryLock;
+condition_variable GPIO::registryClosed;
+map<int32_t, weak_ptr<GPIO>> GPIO::registry;
 
 inline void GPIO::dEdgeInterruption(string getedg_str)
 {
@@ -218,16 +341,77 @@ GPIO::GPIO(int32_t n) : GPIONumber(n)
     getedg_str = GPIODirectory + "gpio" + GPIONumberString + "/edge";
     getval_str = setval_str;
     setdir_str = GPIODirectory + "gpio" + GPIONumberString + "/direction";
+
+    if (accessMode == GPIO_MODE_SIMULATED)
+    {
+        // A FIFO in the fake sysfs tree is opened read-write, so that writers coming and going never make it report EOF
+        struct stat st;
+        if (stat(getval_str.c_str(), &st) == 0 && S_ISFIFO(st.st_mode))
+        {
+            sim_rd = sim_wr = open(getval_str.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+            if (sim_rd == -1)
+                throw std::runtime_error("OPERATION FAILED: Unable to open simulated GPIO"s +
+                                         this->GPIONumberString);
+        }
+        else
+        {
+            int32_t fds[2];
+            if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) == -1)
+                throw std::runtime_error("OPERATION FAILED: Unable to create simulated GPIO"s +
+                                         this->GPIONumberString);
+            sim_rd = fds[0];
+            sim_wr = fds[1];
+        }
+        return;
+    }
     _export();
 }
 
-GPIO::~GPIO() { this->_unexport(); }
+GPIO::~GPIO()
+{
+    if (edge_fd != -1 && edge_fd != sim_rd)
+        close(edge_fd);
+    if (accessMode == GPIO_MODE_SIMULATED)
+    {
+        if (sim_wr != sim_rd)
+            close(sim_wr);
+        close(sim_rd);
+        return;
+    }
+    this->_unexport();
+}
 
 shared_ptr<GPIO> GPIO::openGPIO(int32_t n, GPIODirection direction)
 {
-    auto newGPIOObject = make_shared<GPIO>(n);
+    // A pin being unexported by its last user has to be gone before it is exported again
+    unique_lock<mutex> guard(registryLock);
+    shared_ptr<GPIO> GPIOObject;
+    registryClosed.wait(guard, [&] {
+        auto entry = registry.find(n);
+        return entry == registry.end() || (GPIOObject = entry->second.lock());
+    });
+    if (GPIOObject)
+    {
+        // Not under the lock: if this throws, the copy may be the last one and its deleter takes the lock
+        guard.unlock();
+        if (GPIOObject->getDirection() != direction)
+            GPIOObject->setDirection(direction);
+        return GPIOObject;
+    }
+
+    // Held while exporting, so the pin is exported once
+    unique_ptr<GPIO> newGPIOObject(new GPIO(n));
     newGPIOObject->setDirection(direction);
-    return newGPIOObject;
+    GPIOObject = shared_ptr<GPIO>(newGPIOObject.release(), [](GPIO *gpio) {
+        // The expired entry stays until the pin is unexported, so openGPIO waits for it
+        int32_t n = gpio->getNumber();
+        delete gpio;
+        lock_guard<mutex> guard(registryLock);
+        registry.erase(n);
+        registryClosed.notify_all();
+    });
+    registry[n] = GPIOObject;
+    return GPIOObject;
 }
 
 void GPIO::setMode(GPIOMode mode)
@@ -236,6 +420,62 @@ void GPIO::setMode(GPIOMode mode)
         setup_io();
 }
 
+void GPIO::setDirectory(string directory)
+{
+    GPIO::GPIODirectory = directory;
+}
+
+void GPIO::inject(bool value)
+{
+    if (accessMode != GPIO_MODE_SIMULATED)
+        throw std::runtime_error("OPERATION FAILED: Unable to inject a value into GPIO"s +
+                                 this->GPIONumberString +
+                                 " (it is not simulated).");
+    // The level changes when the reader consumes this, so every edge is seen in order
+    char c = value ? '1' : '0';
+    while (::write(sim_wr, &c, 1) == -1 && errno == EAGAIN)
+    {
+        // The reader is behind, let it drain the pipe
+        pollfd pollData{sim_wr, POLLOUT, 0};
+        poll(&pollData, 1, -1);
+    }
+}
+
+int32_t GPIO::getInjectFd()
+{
+    if (accessMode != GPIO_MODE_SIMULATED)
+        throw std::runtime_error("OPERATION FAILED: Unable to inject a value into GPIO"s +
+                                 this->GPIONumberString +
+                                 " (it is not simulated).");
+    return sim_wr;
+}
+
+/// Waits for the next '0'/'1' written to a simulated pin and stores it as the pin's level. Any other characters (like the newline from `echo 1 > value`) are skipped.
+/// @return The '0' or '1' consumed, or '\0' if the timeout ran out before a level arrived
+inline char GPIO::simConsume(int32_t timeout)
+{
+    pollfd pollData{sim_rd, POLLIN, 0};
+    char buffer{'\0'};
+    while (true)
+    {
+        ssize_t n = ::read(sim_rd, &buffer, 1);
+        if (n == 1)
+        {
+            if (buffer == '0' || buffer == '1')
+            {
+                simLevel = (buffer == '1');
+                return buffer;
+            }
+            continue;
+        }
+        if (n == -1 && errno != EAGAIN && errno != EINTR)
+            throw std::runtime_error("OPERATION FAILED: Unable to perform edge detection on GPIO"s +
+                                     this->GPIONumberString);
+        if (poll(&pollData, 1, timeout) == 0)
+            return '\0';
+    }
+}
+
 void GPIO::_export()
 {
     FILE *exportgpio = fopen(export_str.c_str(), "w");
@@ -258,8 +498,51 @@ void GPIO::_unexport()
     return;
 }
 
+/// Opens a file of an exported pin, waiting up to timeOut for it to become usable. Right after _export() udev is still fixing the permissions, so instead of retrying on a timer this waits for inotify to report a change in the pin's directory and tries again at once.
+/// @return The opened file, or nullptr if it could not be opened in time
+FILE *GPIO::openWhenReady(const string &path, const char *mode)
+{
+    FILE *file = fopen(path.c_str(), mode);
+    if (file)
+        return file;
+
+    // Without a watch the poll() below only waits, so it retries every 10 ms like a plain retry loop would
+    int32_t notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    bool watching = notify_fd != -1 &&
+                    inotify_add_watch(notify_fd, path.substr(0, path.rfind('/')).c_str(), IN_ATTRIB | IN_CREATE | IN_MOVED_TO) != -1;
+    int32_t slice = watching ? 100 : 10;
+
+    auto _clk = CHRONO_NOW;
+    // Tried again after the watch is in place, so a change in between is not missed
+    while (!(file = fopen(path.c_str(), mode)))
+    {
+        auto left = chrono::duration_cast<chrono::milliseconds>(this->timeOut - (CHRONO_NOW - _clk)).count();
+        if (left <= 0)
+            break;
+        // Not every change in sysfs is reported, so don't sleep through the whole timeout on it
+        pollfd pollData{notify_fd, POLLIN, 0};
+        if (poll(&pollData, 1, (int32_t)min<decltype(left)>(left, slice)) > 0)
+        {
+            char events[sizeof(inotify_event) + NAME_MAX + 1];
+            while (::read(notify_fd, events, sizeof(events)) > 0)
+                ;
+        }
+    }
+    if (notify_fd != -1)
+        close(notify_fd);
+    return file;
+}
+
 inline void GPIO::waitForEdge(GPIOEdge edgeType, int32_t timeout)
 {
+    if (accessMode == GPIO_MODE_SIMULATED)
+    {
+        char level;
+        while ((level = simConsume(timeout)) && (int32_t)(level - '0') != edgeType)
+            ;
+        return;
+    }
+
     int32_t edge_fd = open(getedg_str.c_str(), O_RDWR);
     if (edge_fd == -1)
         throw std::runtime_error("OPERATION FAILED: Unable to perform edge detection on GPIO"s +
@@ -292,6 +575,15 @@ inline void GPIO::waitForEdge(GPIOEdge edgeType, int32_t timeout)
 
 inline GPIOEdge GPIO::waitForAnyEdge(int32_t timeout)
 {
+    if (accessMode == GPIO_MODE_SIMULATED)
+    {
+        // Like the sysfs path, a timeout reports the current level
+        char level = simConsume(timeout);
+        if (!level)
+            return (simLevel ? GPIO_EDGE_RISING : GPIO_EDGE_FALLING);
+        return (level == '1' ? GPIO_EDGE_RISING : GPIO_EDGE_FALLING);
+    }
+
     int32_t edge_fd = open(getedg_str.c_str(), O_RDWR);
     if (edge_fd == -1)
         throw std::runtime_error("OPERATION FAILED: Unable to perform edge detection on GPIO"s +
@@ -322,6 +614,78 @@ inline GPIOEdge GPIO::waitForAnyEdge(int32_t timeout)
     return ((buffer - '0') ? GPIO_EDGE_RISING : GPIO_EDGE_FALLING);
 }
 
+shared_ptr<GPIO> GPIO::waitForAnyEdge(const vector<shared_ptr<GPIO>> &pins, GPIOEdge &edge, int32_t timeout, int32_t wakeFd)
+{
+    vector<pollfd> pollData;
+    for (auto &pin : pins)
+        pollData.push_back({pin->getEdgeFd(), pin->getEdgeEvents(), 0});
+    pollData.push_back({wakeFd, POLLIN, 0}); // Ignored by poll() when -1
+
+    while (true)
+    {
+        int ready = poll(pollData.data(), pollData.size(), timeout);
+        if (ready < 0 && errno == EINTR)
+            continue;
+        if (ready < 0)
+            throw std::runtime_error("OPERATION FAILED: Unable to wait for an edge on any GPIO ("s + strerror(errno) + ").");
+        if (ready == 0 || pollData.back().revents)
+        {
+            edge = GPIO_EDGE_NONE;
+            return nullptr;
+        }
+        TRACE_INSTANT("gpio wake");
+        for (size_t i = 0; i < pins.size(); i++)
+            if (pollData[i].revents && (edge = pins[i]->readEdge()) != GPIO_EDGE_NONE)
+                return pins[i];
+    }
+}
+
+int32_t GPIO::getEdgeFd()
+{
+    if (edge_fd != -1)
+        return edge_fd;
+    if (accessMode == GPIO_MODE_SIMULATED)
+        return edge_fd = sim_rd;
+
+    FILE *fd = fopen(getedg_str.c_str(), "w");
+    if (!fd)
+        throw std::runtime_error("OPERATION FAILED: Unable to perform edge detection on GPIO"s +
+                                 this->GPIONumberString);
+    fwrite("both", 1, 4, fd);
+    fclose(fd);
+
+    edge_fd = open(getval_str.c_str(), O_RDONLY | O_CLOEXEC);
+    if (edge_fd == -1)
+        throw std::runtime_error("OPERATION FAILED: Unable to perform edge detection on GPIO"s +
+                                 this->GPIONumberString);
+    char buffer{'\0'};
+    ::read(edge_fd, &buffer, 1); // a dummy read is required before polling
+    return edge_fd;
+}
+
+short GPIO::getEdgeEvents()
+{
+    return (accessMode == GPIO_MODE_SIMULATED) ? POLLIN : POLLPRI | POLLERR;
+}
+
+GPIOEdge GPIO::readEdge()
+{
+    TRACE_SCOPE("read edge");
+    if (accessMode == GPIO_MODE_SIMULATED)
+    {
+        char level = simConsume(0);
+        if (!level)
+            return GPIO_EDGE_NONE;
+        return (level == '1' ? GPIO_EDGE_RISING : GPIO_EDGE_FALLING);
+    }
+
+    char buffer{'\0'};
+    lseek(getEdgeFd(), 0, SEEK_SET);
+    if (::read(edge_fd, &buffer, 1) != 1)
+        return GPIO_EDGE_NONE;
+    return ((buffer - '0') ? GPIO_EDGE_RISING : GPIO_EDGE_FALLING);
+}
+
 void GPIO::setDirection(GPIODirection direction)
 {
     if (direction > 2)
@@ -331,21 +695,10 @@ void GPIO::setDirection(GPIODirection direction)
 
     if (accessMode == GPIO_MODE_SYSFS)
     {
-        FILE *setdirgpio = fopen(setdir_str.c_str(), "w");
+        FILE *setdirgpio = openWhenReady(setdir_str, "w");
         if (!setdirgpio)
-        {
-            auto _clk = CHRONO_NOW;
-            while (CHRONO_NOW - _clk < this->timeOut)
-            {
-                setdirgpio = fopen(setdir_str.c_str(), "w");
-                if (setdirgpio)
-                    break;
-                usleep(10000); // 10ms
-            };
-            if (!setdirgpio)
-                throw std::runtime_error("OPERATION FAILED: Unable to set direction of GPIO"s +
-                                         this->GPIONumberString);
-        }
+            throw std::runtime_error("OPERATION FAILED: Unable to set direction of GPIO"s +
+                                     this->GPIONumberString);
         string direction_str{""};
         switch (direction)
         {
@@ -388,6 +741,13 @@ void GPIO::setDirection(GPIODirection direction)
         this->curDirection = direction;
         return;
     }
+    else if (accessMode == GPIO_MODE_SIMULATED)
+    {
+        if (direction != GPIO_INPUT)
+            simLevel = (direction == GPIO_OUTPUT_INIT_HIGH);
+        this->curDirection = direction;
+        return;
+    }
     else
         throw std::runtime_error("OPERATION FAILED: Unable to determine access mode for GPIO"s +
                                  this->GPIONumberString);
@@ -404,25 +764,19 @@ inline void GPIO::write(bool value)
 
     if (accessMode == GPIO_MODE_SYSFS)
     {
-        FILE *setvalgpio = fopen(setval_str.c_str(), "w");
+        FILE *setvalgpio = openWhenReady(setval_str, "w");
         if (!setvalgpio)
-        {
-            auto _clk = CHRONO_NOW;
-            while (CHRONO_NOW - _clk < this->timeOut)
-            {
-                setvalgpio = fopen(setval_str.c_str(), "w");
-                if (setvalgpio)
-                    break;
-                usleep(10000); // 10ms
-            }
-            if (!setvalgpio)
-                throw std::runtime_error("OPERATION FAILED: Unable to set the value of GPIO"s +
-                                         this->GPIONumberString);
-        }
+            throw std::runtime_error("OPERATION FAILED: Unable to set the value of GPIO"s +
+                                     this->GPIONumberString);
         fwrite((value) ? "1" : "0", 1, 1, setvalgpio);
         fclose(setvalgpio);
         return;
     }
+    else if (accessMode == GPIO_MODE_SIMULATED)
+    {
+        simLevel = value;
+        return;
+    }
     else
     {
         if (value)
@@ -437,21 +791,10 @@ inline bool GPIO::read()
 {
     if (accessMode == GPIO_MODE_SYSFS)
     {
-        FILE *getvalgpio = fopen(getval_str.c_str(), "r");
+        FILE *getvalgpio = openWhenReady(getval_str, "r");
         if (!getvalgpio)
-        {
-            auto _clk = CHRONO_NOW;
-            while (CHRONO_NOW - _clk < this->timeOut)
-            {
-                getvalgpio = fopen(getval_str.c_str(), "r");
-                if (getvalgpio)
-                    break;
-                usleep(10000); // 10ms
-            }
-            if (!getvalgpio)
-                throw std::runtime_error("OPERATION FAILED: Unable to get the value of GPIO"s +
-                                         this->GPIONumberString);
-        }
+            throw std::runtime_error("OPERATION FAILED: Unable to get the value of GPIO"s +
+                                     this->GPIONumberString);
         char buffer{'\0'};
         fread(&buffer, 1, 1, getvalgpio);
         fclose(getvalgpio);
@@ -463,6 +806,10 @@ inline bool GPIO::read()
             throw std::runtime_error("OPERATION FAILED: Unable to get the value of GPIO"s +
                                      this->GPIONumberString);
     }
+    else if (accessMode == GPIO_MODE_SIMULATED)
+    {
+        return simLevel;
+    }
     else
     {
         return GET_GPIO(this->GPIONumber);
@@ -471,6 +818,13 @@ inline bool GPIO::read()
 
 int32_t GPIO::getNumber() { return this->GPIONumber; }
 
+inline uint32_t GPIO::readLevels()
+{
+    if (accessMode != GPIO_MODE_DIRECT)
+        throw std::runtime_error("OPERATION FAILED: Unable to read the levels of all GPIOs (they are not accessed directly).");
+    return *(gpio + 13);
+}
+
 #endif /* !defined(__cplusplus) || __cplusplus < 201300L */
 
 #endif /* _GPIO_HPP_ */
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "lifx.hpp"
+#include "pirtimer.hpp"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Plays precomputed frames on multizone strips at a steady rate. Every frame is one
+/// SetExtendedColorZones packet per strip, written into the same buffer each time, and the
+/// strip fades from frame to frame over the frame period so a low rate still looks smooth.
+class Animation
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// @param strips The strips to play on
+    /// @param frameList The colors of every zone, frame after frame
+    /// @param zoneCount Zones per frame, at most lifxMaxZones
+    /// @param framePeriod Time between frames
+    template <class Rep, class Period>
+    Animation(std::vector<Target> strips, std::vector<LifxColor> frameList, uint8_t zoneCount, std::chrono::duration<Rep, Period> framePeriod)
+        : targets(std::move(strips)), frames(std::move(frameList)), zones(std::min<uint8_t>(zoneCount, lifxMaxZones)),
+          period(std::chrono::duration_cast<Clock::duration>(framePeriod))
+    {
+        frameCount = zones ? frames.size() / zones : 0;
+    }
+
+    /// Frames of a rainbow moving along the strip, one full turn of hue per cycle
+    /// @param zoneCount Zones per frame, at most lifxMaxZones
+    /// @param frameCount Frames per cycle
+    /// @param brightness The brightness of every zone
+    static std::vector<LifxColor> rainbow(uint8_t zoneCount, size_t frameCount, uint16_t brightness)
+    {
+        std::vector<LifxColor> result;
+        result.reserve(zoneCount * frameCount);
+        for (size_t f = 0; f < frameCount; f++)
+            for (uint8_t z = 0; z < zoneCount; z++)
+            {
+                double turn = (double)z / zoneCount + (double)f / frameCount;
+                result.push_back({(uint16_t)std::lround(std::fmod(turn, 1.0) * UINT16_MAX), UINT16_MAX, brightness, 3500});
+            }
+        return result;
+    }
+
+    ~Animation() { stop(); }
+
+    bool isRunning() { return running; }
+
+    /// Play the frames in a loop, from the first one
+    void start()
+    {
+        stop();
+        if (frameCount == 0)
+            return;
+        running = true;
+        t_play = std::thread(&Animation::worker, this);
+    }
+
+    void stop()
+    {
+        if (running)
+        {
+            std::lock_guard<std::mutex> guard(mx);
+            running = false;
+        }
+        cond.notify_one();
+        if (t_play.joinable())
+            t_play.join();
+    }
+
+private:
+    std::vector<Target> targets;
+    std::vector<LifxColor> frames;
+    uint8_t zones;
+    size_t frameCount;
+    Clock::duration period;
+
+    std::atomic<bool> running{false};
+    std::mutex mx;
+    std::condition_variable cond;
+    std::thread t_play;
+
+    void worker()
+    {
+        uint8_t packet[lifxSetExtendedColorZonesSize];
+        uint32_t fade = (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(period).count();
+        lifxSetExtendedColorZones(packet, frames.data(), zones, fade);
+
+        // Absolute deadlines, so the time spent sending does not slow the animation down
+        Clock::time_point next = Clock::now();
+        std::unique_lock<std::mutex> guard(mx);
+        for (size_t frame = 0; running; frame = (frame + 1) % frameCount)
+        {
+            lifxPutZones(packet, &frames[frame * zones], zones);
+            guard.unlock();
+            sendAll(packet, targets);
+            guard.lock();
+            next += period;
+            cond.wait_until(guard, next, [this] { return !running; });
+        }
+    }
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/// Stops sending to a bulb that keeps failing, so an unreachable bulb costs nothing while
+/// the others keep getting their packets. After a few failures in a row the breaker opens
+/// and the bulb is skipped for a backoff that doubles with every failed retry, up to a
+/// minute. When the backoff is over a single packet is let through as a probe, and one
+/// that goes through closes the breaker again. Safe to use from several threads.
+class CircuitBreaker
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// Failures in a row before the bulb is skipped
+    static constexpr int threshold = 3;
+    static constexpr Clock::duration minBackoff = std::chrono::seconds(1);
+    static constexpr Clock::duration maxBackoff = std::chrono::minutes(1);
+
+    /// The breaker for a bulb, the same one for every zone that uses it
+    /// @param key Identifies the bulb, e.g. "host:port"
+    static CircuitBreaker &of(const std::string &key)
+    {
+        static std::mutex mx;
+        static std::unordered_map<std::string, CircuitBreaker> breakers; // Never erased, so references stay valid
+        std::lock_guard<std::mutex> guard(mx);
+        return breakers[key];
+    }
+
+    /// @return Whether to try sending now
+    bool allow(Clock::time_point now = Clock::now())
+    {
+        auto until = openUntil.load(std::memory_order_relaxed);
+        if (until == 0)
+            return true;
+        if (now.time_since_epoch().count() < until)
+            return false;
+        // Half open: whoever moves the deadline on gets to send the probe
+        return openUntil.compare_exchange_strong(until, (now + backoff()).time_since_epoch().count());
+    }
+
+    /// A packet went through
+    /// @return true if this closed the breaker
+    bool success()
+    {
+        if (failures.load(std::memory_order_relaxed) == 0)
+            return false;
+        failures = 0;
+        return openUntil.exchange(0) != 0;
+    }
+
+    /// A packet could not be sent
+    /// @return true if this failure opened the breaker
+    bool failure(Clock::time_point now = Clock::now())
+    {
+        int count = ++failures;
+        if (count < threshold)
+            return false;
+        openUntil = (now + backoff()).time_since_epoch().count();
+        return count == threshold;
+    }
+
+    /// @return Whether the bulb is being skipped
+    bool isOpen() { return openUntil.load(std::memory_order_relaxed) != 0; }
+
+    /// @return How long the bulb is skipped after the current number of failures
+    Clock::duration backoff()
+    {
+        int doublings = std::min(std::max(failures.load(std::memory_order_relaxed) - threshold, 0), 16);
+        return std::min(minBackoff * (1 << doublings), maxBackoff);
+    }
+
+private:
+    std::atomic<int> failures{0};
+    /// Clock ticks until which the bulb is skipped, 0 while the breaker is closed
+    std::atomic<Clock::rep> openUntil{0};
+};
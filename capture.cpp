@@ -0,0 +1,254 @@
+/**
+ * PirTimer
+ * capture.cpp
+ * Purpose: Samples PIR pins at a fixed high rate and saves the waveform run-length encoded
+ * Dependencies: GPIO.hpp, a Pi (GPIO_MODE_DIRECT) or a simulated GPIO tree
+ *
+ * sysfs edges come late and short pulses get lost in them, so this reads the
+ * GPLEV0 register directly instead, all 32 pins in one load, from a thread pinned
+ * to its own CPU that spins until each sample is due. Every sample goes into a
+ * buffer allocated for the whole capture up front, so none can be lost, which caps
+ * rate times duration at maxSamples. Only the changes are written out afterwards. Every line of the output is
+ * "<samples> <levels>", the levels one 0/1 per pin in the order given, and the
+ * shortest high and low pulses per pin are printed at the end to help choosing a
+ * debounce time. Pirtimer can keep running: the pins are only read.
+ *
+ * Usage: ./capture [-s simulated gpio directory] [-r samples per second] [-d seconds] [-c cpu] [-o file] [pin]...
+*/
+
+#include "GPIO.hpp"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <fstream>
+#include <iostream>
+#include <pthread.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+/// The most samples a capture holds in memory, 128 MiB, e.g. 5 minutes at 100 kHz
+constexpr double maxSamples = 1 << 25;
+
+/// The shortest pulses of one pin, in samples. The first and last runs are cut off by
+/// the start and end of the capture, so they don't count.
+struct Pulses
+{
+  int32_t pin;
+  bool level = false;
+  uint64_t since = 0;
+  bool seenChange = false;
+  uint64_t shortest[2] = {ULLONG_MAX, ULLONG_MAX};
+};
+
+int main(int argc, char **argv)
+{
+  std::string simulated;
+  double rate = 100000;
+  double seconds = 10;
+  int cpu = (int)std::thread::hardware_concurrency() - 1;
+  std::string output = "capture.rle";
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:r:d:c:o:")) != -1)
+  {
+    switch (opt)
+    {
+    case 's':
+      simulated = std::string(optarg) + "/";
+      break;
+    case 'r':
+      rate = std::stod(optarg);
+      break;
+    case 'd':
+      seconds = std::stod(optarg);
+      break;
+    case 'c':
+      cpu = std::stoi(optarg);
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    default:
+      std::cerr << "Usage: " << argv[0] << " [-s simulated gpio directory] [-r samples per second] [-d seconds] [-c cpu] [-o file] [pin]..." << std::endl;
+      return 1;
+    }
+  }
+  std::vector<int32_t> pins;
+  for (int i = optind; i < argc; i++)
+    pins.push_back(std::stoi(argv[i]));
+  if (pins.empty())
+    pins.push_back(17);
+  uint32_t mask = 0;
+  for (auto pin : pins)
+  {
+    if (pin < 0 || pin > 31)
+    {
+      std::cerr << "Only the pins 0-31 are in GPLEV0" << std::endl;
+      return 1;
+    }
+    mask |= 1u << pin;
+  }
+  if (rate <= 0 || seconds <= 0)
+  {
+    std::cerr << "The rate and duration have to be positive" << std::endl;
+    return 1;
+  }
+  if (rate * seconds > maxSamples)
+  {
+    std::cerr << "At most " << (uint64_t)maxSamples << " samples fit in memory, lower the rate or the duration" << std::endl;
+    return 1;
+  }
+
+  // Off a Pi the simulated pins are opened and drained instead of reading the register
+  std::vector<std::shared_ptr<GPIO>> simulatedPins;
+  if (simulated.empty())
+    GPIO::setMode(GPIO_MODE_DIRECT);
+  else
+  {
+    GPIO::setMode(GPIO_MODE_SIMULATED);
+    GPIO::setDirectory(simulated);
+    for (auto pin : pins)
+      simulatedPins.push_back(GPIO::openGPIO(pin, GPIO_INPUT));
+  }
+  auto sample = [&]() -> uint32_t {
+    if (simulatedPins.empty())
+      return GPIO::readLevels();
+    uint32_t levels = 0;
+    for (auto &pin : simulatedPins)
+    {
+      while (pin->readEdge() != GPIO_EDGE_NONE)
+        ;
+      levels |= (uint32_t)pin->read() << pin->getNumber();
+    }
+    return levels;
+  };
+
+  std::ofstream out(output);
+  if (!out)
+  {
+    perror(output.c_str());
+    return 1;
+  }
+
+  // Written to here once, so the pages are in memory before sampling starts
+  const uint64_t total = (uint64_t)(rate * seconds);
+  std::vector<uint32_t> samples(total);
+  const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1 / rate));
+  uint64_t late = 0;
+  Clock::duration worst{0};
+
+  auto run = [&] {
+    // The sample times are absolute, so a late sample does not shift the ones after it
+    auto due = Clock::now();
+    for (uint64_t i = 0; i < total; i++)
+    {
+      due += period;
+      Clock::time_point now;
+      while ((now = Clock::now()) < due)
+        ;
+      if (now - due > period)
+      {
+        late++;
+        worst = std::max(worst, now - due);
+      }
+      samples[i] = sample();
+    }
+  };
+  auto entry = [](void *arg) -> void * {
+    (*static_cast<decltype(run) *>(arg))();
+    return nullptr;
+  };
+
+  // Pinned before it starts, so not a single sample is taken on another CPU
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(std::max(cpu, 0), &cpus);
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_t sampler;
+  if (pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus) != 0 ||
+      pthread_create(&sampler, &attr, entry, &run) != 0)
+  {
+    std::cerr << "Unable to pin the sampling thread to CPU " << cpu << ", the timing will suffer" << std::endl;
+    if (pthread_create(&sampler, nullptr, entry, &run) != 0)
+    {
+      std::cerr << "Unable to start the sampling thread" << std::endl;
+      return 1;
+    }
+  }
+  pthread_attr_destroy(&attr);
+  pthread_join(sampler, nullptr);
+
+  out << "# pirtimer capture: pins";
+  for (auto pin : pins)
+    out << " " << pin;
+  out << ", " << rate << " samples per second\n# samples levels\n";
+
+  std::vector<Pulses> pulses;
+  for (auto pin : pins)
+    pulses.push_back({pin});
+  uint64_t at = 0, runStart = 0, runs = 0;
+  uint32_t current = 0;
+  auto writeRun = [&] {
+    out << at - runStart << " ";
+    for (auto pin : pins)
+      out << ((current >> pin) & 1);
+    out << "\n";
+    runs++;
+  };
+
+  for (uint32_t levels : samples)
+  {
+    levels &= mask;
+    if (at == 0)
+    {
+      current = levels;
+      for (auto &p : pulses)
+        p.level = (levels >> p.pin) & 1;
+    }
+    else if (levels != current)
+    {
+      writeRun();
+      for (auto &p : pulses)
+      {
+        bool level = (levels >> p.pin) & 1;
+        if (level == p.level)
+          continue;
+        if (p.seenChange)
+          p.shortest[p.level] = std::min(p.shortest[p.level], at - p.since);
+        p.seenChange = true;
+        p.level = level;
+        p.since = at;
+      }
+      current = levels;
+      runStart = at;
+    }
+    at++;
+  }
+  if (at > runStart)
+    writeRun();
+  out.close();
+
+  double us = 1e6 / rate;
+  std::cout << at << " samples, " << runs << " runs written to " << output << std::endl;
+  std::cout << late << " samples more than a period late (worst "
+            << std::chrono::duration_cast<std::chrono::microseconds>(worst).count() << " us)" << std::endl;
+  for (auto &p : pulses)
+  {
+    std::cout << "GPIO" << p.pin << " shortest pulse:";
+    for (int level : {1, 0})
+    {
+      std::cout << (level ? " high " : ", low ");
+      if (p.shortest[level] == ULLONG_MAX)
+        std::cout << "none";
+      else
+        std::cout << p.shortest[level] * us << " us";
+    }
+    std::cout << std::endl;
+  }
+  return 0;
+}
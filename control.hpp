@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <poll.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+/// Where pirtimer -c and pirctl meet unless told otherwise
+constexpr const char *defaultControlPath = "/run/pirtimer.sock";
+
+/// The largest command or reply, in bytes
+constexpr size_t maxControlMessage = 64 * 1024;
+
+/// Open a SOCK_SEQPACKET Unix socket address for a path
+/// @param path The socket file
+/// @param address Where to store the address
+inline void controlAddress(const std::string &path, sockaddr_un &address)
+{
+    address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        throw std::runtime_error("OPERATION FAILED: Socket path too long: " + path);
+    strcpy(address.sun_path, path.c_str());
+}
+
+/// Takes commands on a Unix socket without a thread of its own: the owner polls the fds it
+/// hands out and calls handle() with the results, so commands run on the owner's thread
+/// between edges and never block it. Every connection carries one command, a single
+/// SOCK_SEQPACKET message of words separated by spaces, and gets one reply message back.
+class ControlServer
+{
+public:
+    /// Runs a command and returns the reply
+    using Handler = std::function<std::string(const std::vector<std::string> &words)>;
+
+    /// The most connections waiting for their command at once, the oldest is dropped
+    static constexpr size_t maxClients = 8;
+
+    /// @param socketPath The socket file, replaced if it exists
+    /// @param commandHandler Called for every command
+    ControlServer(const std::string &socketPath, Handler commandHandler) : path(socketPath), handler(std::move(commandHandler))
+    {
+        sockaddr_un address;
+        controlAddress(path, address);
+        unlink(path.c_str());
+        listener = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listener < 0 || bind(listener, (sockaddr *)&address, sizeof(address)) < 0 || listen(listener, 4) < 0)
+        {
+            int err = errno;
+            if (listener >= 0)
+                close(listener);
+            throw std::runtime_error("OPERATION FAILED: Unable to open control socket " + path + ": " + strerror(err));
+        }
+    }
+
+    ~ControlServer()
+    {
+        for (int client : clients)
+            close(client);
+        close(listener);
+        unlink(path.c_str());
+    }
+
+    /// Add the fds to wait for, after whatever the owner waits for itself
+    /// @param fds The poll set
+    void addPollFds(std::vector<pollfd> &fds) const
+    {
+        fds.push_back({listener, POLLIN, 0});
+        for (int client : clients)
+            fds.push_back({client, POLLIN, 0});
+    }
+
+    /// Accept connections and run commands that are ready
+    /// @param ready The fds added by addPollFds(), after poll()
+    void handle(const pollfd *ready)
+    {
+        std::vector<int> waiting;
+        for (size_t i = 0; i < clients.size(); i++)
+        {
+            if (ready[i + 1].revents)
+                serve(clients[i]);
+            else
+                waiting.push_back(clients[i]);
+        }
+        clients.swap(waiting);
+
+        if (ready[0].revents & POLLIN)
+        {
+            int client;
+            while ((client = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+            {
+                if (clients.size() == maxClients)
+                {
+                    close(clients.front());
+                    clients.erase(clients.begin());
+                }
+                clients.push_back(client);
+            }
+        }
+    }
+
+private:
+    std::string path;
+    Handler handler;
+    int listener = -1;
+    /// Connected, command not read yet
+    std::vector<int> clients;
+
+    void serve(int client)
+    {
+        std::string message(maxControlMessage, '\0');
+        ssize_t length = recv(client, &message[0], message.size(), MSG_DONTWAIT);
+        if (length > 0)
+        {
+            message.resize(length);
+            std::istringstream in(message);
+            std::vector<std::string> words;
+            std::string word;
+            while (in >> word)
+                words.push_back(word);
+
+            std::string reply;
+            try
+            {
+                reply = words.empty() ? "error: empty command\n" : handler(words);
+            }
+            catch (const std::exception &e)
+            {
+                reply = std::string("error: ") + e.what() + "\n";
+            }
+            if (reply.size() > maxControlMessage)
+                reply.resize(maxControlMessage);
+            send(client, reply.data(), reply.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+        }
+        close(client);
+    }
+};
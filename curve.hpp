@@ -0,0 +1,91 @@
+#pragma once
+
+#include "lifx.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <time.h>
+#include <vector>
+
+/// Brightness and color temperature over the day, e.g. bright and cool in the daytime and
+/// dim and warm at night. The curve is given as points that are interpolated linearly,
+/// wrapping around midnight, and is precomputed into a table with one color per minute, so
+/// looking up the color to turn on with costs no floating point.
+class DayCurve
+{
+public:
+    static constexpr int minutesPerDay = 24 * 60;
+
+    /// One point of the curve
+    struct Point
+    {
+        /// Minutes after midnight
+        int minute;
+        /// 0-100 percent
+        double brightness;
+        /// 1500-9000
+        double kelvin;
+    };
+
+    /// Parse a curve like "07:00/100/5000,20:00/80/3500,23:00/30/2700", points as
+    /// time/brightness percent/kelvin
+    /// @param spec The points, separated by commas
+    static DayCurve parse(const std::string &spec)
+    {
+        std::vector<Point> points;
+        std::istringstream items(spec);
+        std::string item;
+        while (getline(items, item, ','))
+        {
+            std::istringstream parts(item);
+            std::string time, brightness, kelvin;
+            if (!getline(parts, time, '/') || !getline(parts, brightness, '/') || !getline(parts, kelvin) || time.find(':') == std::string::npos)
+                throw std::invalid_argument(item);
+            auto colon = time.find(':');
+            int minute = std::stoi(time.substr(0, colon)) * 60 + std::stoi(time.substr(colon + 1));
+            if (minute < 0 || minute >= minutesPerDay)
+                throw std::invalid_argument(item);
+            points.push_back({minute, std::stod(brightness), std::stod(kelvin)});
+        }
+        return DayCurve(points);
+    }
+
+    /// @param points At least one point, in any order
+    explicit DayCurve(std::vector<Point> points)
+    {
+        if (points.empty())
+            throw std::invalid_argument("A curve needs at least one point");
+        std::sort(points.begin(), points.end(), [](const Point &a, const Point &b) { return a.minute < b.minute; });
+
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            const Point &from = points[i];
+            const Point &to = points[(i + 1) % points.size()];
+            int length = (to.minute - from.minute + minutesPerDay - 1) % minutesPerDay + 1; // One point covers the whole day
+            for (int m = 0; m < length; m++)
+            {
+                double t = (double)m / length;
+                double brightness = std::min(std::max(from.brightness + (to.brightness - from.brightness) * t, 0.0), 100.0);
+                double kelvin = std::min(std::max(from.kelvin + (to.kelvin - from.kelvin) * t, 1500.0), 9000.0);
+                table[(from.minute + m) % minutesPerDay] = {0, 0, (uint16_t)std::lround(brightness / 100 * UINT16_MAX), (uint16_t)std::lround(kelvin)};
+            }
+        }
+    }
+
+    /// @param minute Minutes after midnight, 0-1439
+    const LifxColor &atMinute(int minute) const { return table[minute]; }
+
+    /// @param now The time to look up, normally the current time
+    const LifxColor &at(time_t now = time(nullptr)) const
+    {
+        tm local;
+        localtime_r(&now, &local);
+        return table[local.tm_hour * 60 + local.tm_min];
+    }
+
+private:
+    std::array<LifxColor, minutesPerDay> table;
+};
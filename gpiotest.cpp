@@ -19,7 +19,7 @@ int main()
 {
     auto pir = GPIO::openGPIO(17, GPIO_INPUT);
 
-    Timer t(15, [] {
+    Timer t(std::chrono::minutes(15), [] {
         std::cout << "Timer done" << std::endl;
     });
 
@@ -0,0 +1,230 @@
+/**
+ * PirTimer
+ * latencybench.cpp
+ * Purpose: Measures the time from a PIR rising edge to the lifx packets leaving pirtimer
+ * Dependencies: pirtimer (built), a simulated GPIO tree (see GPIO_MODE_SIMULATED)
+ *
+ * Runs the real daemon on a fake sysfs tree with its targets pointed at a loopback
+ * listener, then feeds it rising edges and times when each datagram arrives.
+ * Every "on" is a SetColor and a SetPower to each of the two targets; the first
+ * and the last of them are reported.
+ * Each rising edge is followed by a falling one, and the countdown is a few
+ * milliseconds, so the lights are off again before the next edge: motion while
+ * they are on (correctly) sends nothing.
+ *
+ * Usage: ./latencybench [-n edges] [-w warmup edges] [-i ms between edges] [-p path to pirtimer]
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <ftw.h>
+#include <iomanip>
+#include <iostream>
+#include <limits.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+/// SetColor and SetPower, to each of the two targets
+constexpr int packetsPerEdge = 4;
+/// The SetPower off to each target, which receive() takes but does not time
+constexpr int offPackets = 2;
+
+/// Write a value to a file in the scratch directory
+/// @param dir The scratch directory
+/// @param name The file name
+/// @param value The value to write
+void writeFile(const std::string &dir, const std::string &name, const std::string &value)
+{
+  FILE *fd = fopen((dir + "/" + name).c_str(), "w");
+  if (!fd)
+  {
+    perror(name.c_str());
+    exit(1);
+  }
+  fputs(value.c_str(), fd);
+  fclose(fd);
+}
+
+/// Wait for one datagram on the listener
+/// @param sock The listening socket
+/// @param timeout Timeout in milliseconds
+/// @return The time it arrived, or Clock::time_point::min() on timeout or a malformed packet
+Clock::time_point receive(int sock, int timeout)
+{
+  pollfd pollData{sock, POLLIN, 0};
+  if (poll(&pollData, 1, timeout) <= 0)
+    return Clock::time_point::min();
+  unsigned char buffer[128];
+  auto n = recv(sock, buffer, sizeof(buffer), 0);
+  auto arrived = Clock::now();
+  // A SetColor packet (49 bytes) or a "turn on" SetPower packet (42 bytes with a non-zero level)
+  bool color = n == 49 && buffer[0] == 49 && buffer[32] == 102;
+  bool power = n == 42 && buffer[0] == 42 && buffer[32] == 117 && (buffer[36] | buffer[37]) != 0;
+  if (!color && !power)
+    return Clock::time_point::min();
+  return arrived;
+}
+
+/// Print p50/p99/max of a set of latencies
+/// @param label What was measured
+/// @param samples The latencies in microseconds, will be sorted
+void report(const std::string &label, std::vector<double> &samples)
+{
+  std::sort(samples.begin(), samples.end());
+  auto at = [&](double q) { return samples[std::min(samples.size() - 1, (size_t)(q * samples.size()))]; };
+  double sum = 0;
+  for (auto s : samples)
+    sum += s;
+  std::cout << std::left << std::setw(14) << label << std::right << std::fixed << std::setprecision(1)
+            << " p50 " << std::setw(9) << at(0.50) << " us"
+            << "  p99 " << std::setw(9) << at(0.99) << " us"
+            << "  max " << std::setw(9) << samples.back() << " us"
+            << "  mean " << std::setw(9) << sum / samples.size() << " us" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  int edges = 1000;
+  int warmup = 50;
+  int interval = 2;
+  std::string daemon = "./pirtimer";
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:w:i:p:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      edges = std::stoi(optarg);
+      break;
+    case 'w':
+      warmup = std::stoi(optarg);
+      break;
+    case 'i':
+      interval = std::stoi(optarg);
+      break;
+    case 'p':
+      daemon = optarg;
+      break;
+    default:
+      std::cerr << "Usage: " << argv[0] << " [-n edges] [-w warmup edges] [-i ms between edges] [-p path to pirtimer]" << std::endl;
+      return 1;
+    }
+  }
+  if (edges < 1)
+    edges = 1;
+
+  char realDaemon[PATH_MAX];
+  if (!realpath(daemon.c_str(), realDaemon))
+  {
+    perror(daemon.c_str());
+    return 1;
+  }
+
+  // Scratch directory holding both the config values and the fake sysfs tree
+  char dirTemplate[] = "/tmp/pirtimer-bench-XXXXXX";
+  if (!mkdtemp(dirTemplate))
+  {
+    perror("mkdtemp");
+    return 1;
+  }
+  std::string dir = dirTemplate;
+  writeFile(dir, "timeout.val", "0.0001"); // Minutes, so the lights go off 6 ms after the motion
+  writeFile(dir, "start.val", "-1"); // Always inside the active window
+  writeFile(dir, "stop.val", "25");
+  mkdir((dir + "/gpio17").c_str(), 0755);
+  std::string fifo = dir + "/gpio17/value";
+  mkfifo(fifo.c_str(), 0644);
+
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in listener{};
+  listener.sin_family = AF_INET;
+  listener.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(listener);
+  if (sock < 0 || bind(sock, (sockaddr *)&listener, length) < 0 || getsockname(sock, (sockaddr *)&listener, &length) < 0)
+  {
+    perror("listener");
+    return 1;
+  }
+  std::string target = "127.0.0.1:" + std::to_string(ntohs(listener.sin_port));
+
+  pid_t child = fork();
+  if (child == 0)
+  {
+    if (chdir(dir.c_str()) != 0)
+      _exit(1);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+    // Two targets, like the bulb and the strip in production
+    execl(realDaemon, realDaemon, "-s", dir.c_str(), "-t", target.c_str(), "-t", target.c_str(), (char *)nullptr);
+    _exit(1);
+  }
+
+  // Blocks until the daemon has opened its end of the FIFO
+  int edge = open(fifo.c_str(), O_WRONLY);
+
+  std::vector<double> first, last;
+  int lost = 0;
+  for (int i = -warmup; i < edges; i++)
+  {
+    auto sent = Clock::now();
+    if (write(edge, "1", 1) != 1)
+    {
+      perror("edge");
+      break;
+    }
+    auto a = receive(sock, 1000);
+    auto b = a;
+    for (int p = 1; p < packetsPerEdge && b != Clock::time_point::min(); p++)
+      b = receive(sock, 1000);
+    if (b == Clock::time_point::min())
+    {
+      lost++;
+      // Let any straggler arrive so it is not counted for the next edge
+      while (receive(sock, 50) != Clock::time_point::min())
+        ;
+    }
+    else if (i >= 0)
+    {
+      first.push_back(std::chrono::duration<double, std::micro>(a - sent).count());
+      last.push_back(std::chrono::duration<double, std::micro>(b - sent).count());
+    }
+    if (write(edge, "0", 1) != 1)
+    {
+      perror("edge");
+      break;
+    }
+    // The off, a SetPower to each target, once the countdown has run out
+    for (int p = 0; p < offPackets; p++)
+      receive(sock, 1000);
+    std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+  }
+
+  close(edge);
+  kill(child, SIGTERM);
+  waitpid(child, nullptr, 0);
+  close(sock);
+  // Depth first, so every directory is empty by the time it is removed
+  auto removeEntry = [](const char *path, const struct stat *, int, FTW *) { return remove(path); };
+  if (nftw(dir.c_str(), removeEntry, 8, FTW_DEPTH | FTW_PHYS) != 0)
+    perror(dir.c_str());
+
+  std::cout << "Motion to packet latency, " << first.size() << " edges (" << lost << " lost)" << std::endl;
+  if (first.empty())
+    return 1;
+  report("first packet", first);
+  report("last packet", last);
+  return lost ? 1 : 0;
+}
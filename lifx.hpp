@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+/// Message types of the lifx LAN protocol (https://lan.developer.lifx.com)
+typedef enum : uint16_t
+{
+    LIFX_SET_COLOR = 102,
+    LIFX_SET_WAVEFORM = 103,
+    LIFX_SET_POWER = 117,
+    LIFX_SET_WAVEFORM_OPTIONAL = 119,
+    LIFX_SET_EXTENDED_COLOR_ZONES = 510
+} LifxMessage;
+
+/// The shape a waveform changes the color in
+typedef enum : uint8_t
+{
+    LIFX_WAVEFORM_SAW = 0,
+    LIFX_WAVEFORM_SINE = 1,
+    LIFX_WAVEFORM_HALF_SINE = 2,
+    LIFX_WAVEFORM_TRIANGLE = 3,
+    LIFX_WAVEFORM_PULSE = 4
+} LifxWaveform;
+
+/// A color, every field between 0 and UINT16_MAX except kelvin (1500-9000)
+struct LifxColor
+{
+    uint16_t hue;
+    uint16_t saturation;
+    uint16_t brightness;
+    uint16_t kelvin;
+};
+
+/// Sizes of the packets, header included
+constexpr size_t lifxHeaderSize = 36;
+constexpr size_t lifxSetPowerSize = lifxHeaderSize + 6;
+constexpr size_t lifxSetColorSize = lifxHeaderSize + 13;
+constexpr size_t lifxSetWaveformSize = lifxHeaderSize + 21;
+constexpr size_t lifxSetWaveformOptionalSize = lifxHeaderSize + 25;
+/// The most zones one SetExtendedColorZones packet can set
+constexpr size_t lifxMaxZones = 82;
+constexpr size_t lifxSetExtendedColorZonesSize = lifxHeaderSize + 8 + lifxMaxZones * 8;
+
+/// The protocol is little endian whatever the host is
+inline void lifxPut16(uint8_t *at, uint16_t value)
+{
+    at[0] = value & 0xff;
+    at[1] = value >> 8;
+}
+
+inline void lifxPut32(uint8_t *at, uint32_t value)
+{
+    lifxPut16(at, value & 0xffff);
+    lifxPut16(at + 2, value >> 16);
+}
+
+inline void lifxPutColor(uint8_t *at, const LifxColor &color)
+{
+    lifxPut16(at, color.hue);
+    lifxPut16(at + 2, color.saturation);
+    lifxPut16(at + 4, color.brightness);
+    lifxPut16(at + 6, color.kelvin);
+}
+
+/// Replace the colors in a SetExtendedColorZones packet, leaving the rest of it as it is
+/// @param packet A packet built with lifxSetExtendedColorZones
+/// @param colors The colors of the zones
+/// @param count How many zones to set, at most lifxMaxZones
+inline void lifxPutZones(uint8_t *packet, const LifxColor *colors, uint8_t count)
+{
+    packet[43] = count;
+    for (uint8_t i = 0; i < count; i++)
+        lifxPutColor(&packet[44 + i * 8], colors[i]);
+}
+
+/// Write the header of a packet
+/// @param packet The packet, at least size bytes
+/// @param size The size of the whole packet
+/// @param type The message type
+/// @param tagged Whether the packet is for every device rather than the one at target. Needed for
+///               broadcasts, and harmless for unicast since only the addressed bulb receives it
+/// @param target The MAC address of the device (in the low 6 bytes), 0 for any
+inline void lifxHeader(uint8_t *packet, uint16_t size, uint16_t type, bool tagged = true, uint64_t target = 0)
+{
+    memset(packet, 0, lifxHeaderSize);
+    lifxPut16(&packet[0], size);
+    lifxPut16(&packet[2], 1024 | 0x1000 | (tagged ? 0x2000 : 0)); // Protocol 1024, addressable
+    lifxPut32(&packet[4], 0x84f03cb4);                           // Source, identifies pirtimer's packets
+    lifxPut32(&packet[8], target & 0xffffffff);
+    lifxPut32(&packet[12], target >> 32);
+    packet[22] = 0x01; // res_required
+    packet[23] = 0x0d; // Sequence
+    lifxPut16(&packet[32], type);
+}
+
+/// Build a SetPower packet
+/// @param packet At least lifxSetPowerSize bytes
+/// @param level 0 to turn off, UINT16_MAX to turn on
+/// @param duration Milliseconds the bulb fades over
+inline void lifxSetPower(uint8_t *packet, uint16_t level, uint32_t duration)
+{
+    lifxHeader(packet, lifxSetPowerSize, LIFX_SET_POWER);
+    lifxPut16(&packet[36], level);
+    lifxPut32(&packet[38], duration);
+}
+
+/// Build a SetColor packet
+/// @param packet At least lifxSetColorSize bytes
+/// @param color The color to change to
+/// @param duration Milliseconds the bulb fades over
+inline void lifxSetColor(uint8_t *packet, const LifxColor &color, uint32_t duration)
+{
+    lifxHeader(packet, lifxSetColorSize, LIFX_SET_COLOR);
+    packet[36] = 0;
+    lifxPutColor(&packet[37], color);
+    lifxPut32(&packet[45], duration);
+}
+
+/// Build a SetWaveform packet, which has the bulb run an effect on its own
+/// @param packet At least lifxSetWaveformSize bytes
+/// @param transient Whether the color goes back to what it was when the effect ends
+/// @param color The color the waveform goes towards
+/// @param period Milliseconds of one cycle
+/// @param cycles How many cycles to run
+/// @param skew How the cycle is skewed, between INT16_MIN and INT16_MAX (0 is even, for PULSE it is the duty cycle)
+/// @param waveform The shape of the effect
+inline void lifxSetWaveform(uint8_t *packet, bool transient, const LifxColor &color, uint32_t period, float cycles, int16_t skew, LifxWaveform waveform)
+{
+    static_assert(sizeof(float) == 4, "cycles is sent as a 32 bit float");
+    uint32_t cyclesBits;
+    memcpy(&cyclesBits, &cycles, sizeof(cyclesBits));
+
+    lifxHeader(packet, lifxSetWaveformSize, LIFX_SET_WAVEFORM);
+    packet[36] = 0;
+    packet[37] = transient;
+    lifxPutColor(&packet[38], color);
+    lifxPut32(&packet[46], period);
+    lifxPut32(&packet[50], cyclesBits);
+    lifxPut16(&packet[54], (uint16_t)skew);
+    packet[56] = waveform;
+}
+
+/// Build a SetWaveformOptional packet: a SetWaveform that only touches the chosen parts of the color
+/// @param packet At least lifxSetWaveformOptionalSize bytes
+/// @param setHue, setSaturation, setBrightness, setKelvin Which parts of color to apply
+/// @see lifxSetWaveform for the other parameters
+inline void lifxSetWaveformOptional(uint8_t *packet, bool transient, const LifxColor &color, uint32_t period, float cycles, int16_t skew, LifxWaveform waveform,
+                                    bool setHue, bool setSaturation, bool setBrightness, bool setKelvin)
+{
+    lifxSetWaveform(packet, transient, color, period, cycles, skew, waveform);
+    lifxHeader(packet, lifxSetWaveformOptionalSize, LIFX_SET_WAVEFORM_OPTIONAL);
+    packet[57] = setHue;
+    packet[58] = setSaturation;
+    packet[59] = setBrightness;
+    packet[60] = setKelvin;
+}
+
+/// Build a SetExtendedColorZones packet, which sets the zones of a multizone strip all at once
+/// @param packet At least lifxSetExtendedColorZonesSize bytes
+/// @param colors The colors of the zones, starting at index
+/// @param count How many zones to set, at most lifxMaxZones
+/// @param duration Milliseconds the strip fades over
+/// @param index The first zone to set
+inline void lifxSetExtendedColorZones(uint8_t *packet, const LifxColor *colors, uint8_t count, uint32_t duration, uint16_t index = 0)
+{
+    lifxHeader(packet, lifxSetExtendedColorZonesSize, LIFX_SET_EXTENDED_COLOR_ZONES);
+    lifxPut32(&packet[36], duration);
+    packet[40] = 1; // Apply
+    lifxPut16(&packet[41], index);
+    memset(&packet[44], 0, lifxMaxZones * 8);
+    lifxPutZones(packet, colors, count);
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "lifx.hpp"
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <netinet/in.h>
+#include <string_view>
+#include <sys/socket.h>
+
+/// Message types of the replies lifx devices send
+typedef enum : uint16_t
+{
+    LIFX_STATE_SERVICE = 3,
+    LIFX_STATE_POWER = 22,
+    LIFX_ACKNOWLEDGEMENT = 45,
+    LIFX_LIGHT_STATE = 107,
+    LIFX_LIGHT_STATE_POWER = 118
+} LifxReplyMessage;
+
+/// The protocol is little endian whatever the host is
+inline uint16_t lifxGet16(const uint8_t *at) { return (uint16_t)(at[0] | at[1] << 8); }
+inline uint32_t lifxGet32(const uint8_t *at) { return lifxGet16(at) | (uint32_t)lifxGet16(at + 2) << 16; }
+inline uint64_t lifxGet64(const uint8_t *at) { return lifxGet32(at) | (uint64_t)lifxGet32(at + 4) << 32; }
+
+/// A received packet, read in place. Views like this one only point into the buffer,
+/// so the buffer has to outlive them, and they never copy or allocate.
+class LifxView
+{
+public:
+    /// Check that a buffer holds a whole lifx packet
+    /// @param data The received bytes
+    /// @param length How many bytes were received
+    /// @return false if it is too short, cut off or not lifx protocol 1024
+    bool parse(const uint8_t *data, size_t length)
+    {
+        bytes = nullptr;
+        if (length < lifxHeaderSize || lifxGet16(data) < lifxHeaderSize || lifxGet16(data) > length || (lifxGet16(data + 2) & 0xfff) != 1024)
+            return false;
+        bytes = data;
+        return true;
+    }
+
+    /// @return Whether the last parse() succeeded
+    explicit operator bool() const { return bytes; }
+
+    uint16_t size() const { return lifxGet16(bytes); }
+    bool tagged() const { return bytes[3] & 0x20; }
+    /// The source of the request this answers, 0x84f03cb4 for pirtimer's own
+    uint32_t source() const { return lifxGet32(bytes + 4); }
+    /// The MAC address of the device that sent it, in the low 6 bytes
+    uint64_t target() const { return lifxGet64(bytes + 8) & 0xffffffffffffull; }
+    uint8_t sequence() const { return bytes[23]; }
+    uint16_t type() const { return lifxGet16(bytes + 32); }
+
+    const uint8_t *payload() const { return bytes + lifxHeaderSize; }
+    size_t payloadSize() const { return size() - lifxHeaderSize; }
+
+    /// Read the packet as one of the reply types below
+    /// @return false if it is another type, or too short to be one
+    template <class Reply>
+    bool as(Reply &reply) const
+    {
+        if (!bytes || !Reply::is(type()) || payloadSize() < Reply::payloadSize)
+            return false;
+        reply.bytes = payload();
+        return true;
+    }
+
+protected:
+    const uint8_t *bytes = nullptr;
+};
+
+/// Answer to GetService, sent by every device during discovery
+struct LifxStateService
+{
+    static constexpr size_t payloadSize = 5;
+    static bool is(uint16_t type) { return type == LIFX_STATE_SERVICE; }
+    const uint8_t *bytes;
+
+    /// 1 for UDP
+    uint8_t service() const { return bytes[0]; }
+    uint32_t port() const { return lifxGet32(bytes + 1); }
+};
+
+/// Power level of a device or a light, 0 when off and UINT16_MAX when on
+struct LifxStatePower
+{
+    static constexpr size_t payloadSize = 2;
+    static bool is(uint16_t type) { return type == LIFX_STATE_POWER || type == LIFX_LIGHT_STATE_POWER; }
+    const uint8_t *bytes;
+
+    uint16_t level() const { return lifxGet16(bytes); }
+};
+
+/// Color, power and label of a light
+struct LifxLightState
+{
+    static constexpr size_t payloadSize = 52;
+    static bool is(uint16_t type) { return type == LIFX_LIGHT_STATE; }
+    const uint8_t *bytes;
+
+    LifxColor color() const { return {lifxGet16(bytes), lifxGet16(bytes + 2), lifxGet16(bytes + 4), lifxGet16(bytes + 6)}; }
+    uint16_t power() const { return lifxGet16(bytes + 10); }
+    /// The name the light was given in the app, not copied
+    std::string_view label() const
+    {
+        const char *text = (const char *)bytes + 12;
+        size_t length = 0;
+        while (length < 32 && text[length])
+            length++;
+        return {text, length};
+    }
+};
+
+/// Sent when a request had ack_required set
+struct LifxAcknowledgement
+{
+    static constexpr size_t payloadSize = 0;
+    static bool is(uint16_t type) { return type == LIFX_ACKNOWLEDGEMENT; }
+    const uint8_t *bytes;
+};
+
+/// Receives up to Count replies with one recvmmsg() call into buffers it owns, and parses
+/// them in one pass over the batch.
+template <size_t Count = 16, size_t Size = 128>
+class LifxBatch
+{
+public:
+    LifxBatch()
+    {
+        for (size_t i = 0; i < Count; i++)
+        {
+            iov[i] = {buffers[i], Size};
+            msgs[i] = {};
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &senders[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(senders[i]);
+        }
+    }
+
+    /// Read whatever replies are waiting on a socket, without blocking
+    /// @param sock A UDP socket
+    /// @return How many datagrams were received, or -1 on error (see errno)
+    int receive(int sock)
+    {
+        for (size_t i = 0; i < Count; i++)
+            msgs[i].msg_hdr.msg_namelen = sizeof(senders[i]);
+        received = recvmmsg(sock, msgs, Count, MSG_DONTWAIT, nullptr);
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            received = 0;
+        return received;
+    }
+
+    /// Call a function for every valid lifx packet in the batch, skipping the rest
+    /// @param visit Called as visit(const LifxView &, const sockaddr_in &sender)
+    /// @return How many packets were valid
+    template <class Visit>
+    size_t parse(Visit visit) const
+    {
+        size_t valid = 0;
+        LifxView view;
+        for (int i = 0; i < received; i++)
+            if (view.parse(buffers[i], msgs[i].msg_len))
+            {
+                visit(view, senders[i]);
+                valid++;
+            }
+        return valid;
+    }
+
+private:
+    uint8_t buffers[Count][Size];
+    iovec iov[Count];
+    mmsghdr msgs[Count];
+    sockaddr_in senders[Count];
+    int received = 0;
+};
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include "trace.hpp"
+#include <netinet/in.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+/// A count that only goes up. Updating it is one relaxed atomic add.
+class Counter
+{
+public:
+    void inc(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value{0};
+};
+
+/// Durations counted into fixed buckets, from 50 us to 5 s. Observing one is a short scan
+/// over the bounds and two relaxed atomic adds, no locks and no allocation.
+class Histogram
+{
+public:
+    /// Upper bounds of the buckets, in microseconds
+    static constexpr std::array<int64_t, 12> bounds{50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 100000, 1000000, 5000000};
+
+    template <class Rep, class Period>
+    void observe(std::chrono::duration<Rep, Period> duration)
+    {
+        int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+        size_t bucket = 0;
+        while (bucket < bounds.size() && us > bounds[bucket])
+            bucket++;
+        counts[bucket].fetch_add(1, std::memory_order_relaxed);
+        sumUs.fetch_add(us, std::memory_order_relaxed);
+    }
+
+    /// Append the histogram in Prometheus text format
+    /// @param out Where to write it
+    /// @param name The metric name, in seconds
+    void render(std::ostream &out, const std::string &name) const
+    {
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i <= bounds.size(); i++)
+        {
+            cumulative += counts[i].load(std::memory_order_relaxed);
+            out << name << "_bucket{le=\"";
+            if (i < bounds.size())
+                out << bounds[i] / 1e6;
+            else
+                out << "+Inf";
+            out << "\"} " << cumulative << "\n";
+        }
+        out << name << "_sum " << sumUs.load(std::memory_order_relaxed) / 1e6 << "\n";
+        out << name << "_count " << cumulative << "\n";
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, bounds.size() + 1> counts{};
+    std::atomic<int64_t> sumUs{0};
+};
+
+/// Everything pirtimer counts about itself, exported in the Prometheus text format
+struct Metrics
+{
+    Counter edges;
+    /// Edges lost because the actuator thread fell too far behind
+    Counter edgesDropped;
+    Counter packetsSent;
+    Counter sendFailures;
+    /// Packets not sent because the bulb's circuit breaker was open
+    Counter sendsSkipped;
+    Counter timerStarts;
+    Counter timerFires;
+    /// From an edge being read to the rules having acted on it, queueing and packets included
+    Histogram edgeHandling;
+    /// How long sending one packet to all of a zone's bulbs takes
+    Histogram sendDuration;
+    /// How late countdowns fire
+    Histogram timerLateness;
+
+    /// The metrics of this process
+    static Metrics &shared()
+    {
+        static Metrics metrics;
+        return metrics;
+    }
+
+    /// @return All metrics in Prometheus text format
+    std::string render() const
+    {
+        std::ostringstream out;
+        auto counter = [&](const char *name, const char *help, const Counter &c) {
+            out << "# HELP " << name << " " << help << "\n# TYPE " << name << " counter\n"
+                << name << " " << c.get() << "\n";
+        };
+        auto histogram = [&](const char *name, const char *help, const Histogram &h) {
+            out << "# HELP " << name << " " << help << "\n# TYPE " << name << " histogram\n";
+            h.render(out, name);
+        };
+        counter("pirtimer_edges_total", "Edges read from the motion sensors.", edges);
+        counter("pirtimer_edges_dropped_total", "Edges dropped because the edge queue was full.", edgesDropped);
+        counter("pirtimer_packets_sent_total", "Packets sent to bulbs.", packetsSent);
+        counter("pirtimer_send_failures_total", "Packets that could not be sent.", sendFailures);
+        counter("pirtimer_sends_skipped_total", "Packets skipped because the bulb was backed off.", sendsSkipped);
+        counter("pirtimer_timer_starts_total", "Countdowns started or restarted.", timerStarts);
+        counter("pirtimer_timer_fires_total", "Countdown stages that fired.", timerFires);
+        histogram("pirtimer_edge_handling_seconds", "Time from reading an edge to having acted on it.", edgeHandling);
+        histogram("pirtimer_send_duration_seconds", "Time to send one packet to all of a zone's bulbs.", sendDuration);
+        histogram("pirtimer_timer_lateness_seconds", "How late countdown stages fire.", timerLateness);
+        return out.str();
+    }
+};
+
+/// Serves Metrics::shared() over HTTP on a loopback TCP port or a Unix socket, from its own
+/// thread, e.g. for "curl localhost:9101/metrics" or "curl --unix-socket pirtimer.sock x/metrics".
+/// A request for /trace gets the trace points as Chrome trace JSON instead (see Trace),
+/// which is empty unless built with PIRTIMER_TRACE.
+class MetricsServer
+{
+public:
+    /// @param where A port number to listen on 127.0.0.1, or the path of a Unix socket
+    explicit MetricsServer(const std::string &where)
+    {
+        bool port = !where.empty() && where.find_first_not_of("0123456789") == std::string::npos;
+        if (port)
+        {
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            address.sin_port = htons((uint16_t)std::stoi(where));
+            listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            int reuse = 1;
+            setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+            if (listener < 0 || bind(listener, (sockaddr *)&address, sizeof(address)) < 0)
+                fail(where);
+        }
+        else
+        {
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            if (where.size() >= sizeof(address.sun_path))
+                throw std::runtime_error("OPERATION FAILED: Socket path too long: " + where);
+            strcpy(address.sun_path, where.c_str());
+            unlink(where.c_str());
+            listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (listener < 0 || bind(listener, (sockaddr *)&address, sizeof(address)) < 0)
+                fail(where);
+            path = where;
+        }
+        if (listen(listener, 4) < 0)
+            fail(where);
+        t_serve = std::thread(&MetricsServer::serve, this);
+    }
+
+    ~MetricsServer()
+    {
+        shutdown(listener, SHUT_RDWR); // Wakes accept()
+        t_serve.join();
+        close(listener);
+        if (!path.empty())
+            unlink(path.c_str());
+    }
+
+private:
+    int listener = -1;
+    std::string path;
+    std::thread t_serve;
+
+    void fail(const std::string &where)
+    {
+        int err = errno;
+        if (listener >= 0)
+            close(listener);
+        throw std::runtime_error("OPERATION FAILED: Unable to serve metrics on " + where + ": " + strerror(err));
+    }
+
+    void serve()
+    {
+        while (true)
+        {
+            int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0)
+            {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                return;
+            }
+            // Only the path in the request line matters
+            timeval timeout{1, 0};
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            char request[1024];
+            ssize_t length = recv(client, request, sizeof(request), 0);
+            if (length >= 0)
+            {
+                bool trace = std::string(request, length).compare(0, 11, "GET /trace ") == 0;
+                std::string body = trace ? Trace::json() : Metrics::shared().render();
+                std::string type = trace ? "application/json" : "text/plain; version=0.0.4";
+                std::string response = "HTTP/1.0 200 OK\r\nContent-Type: " + type + "\r\nContent-Length: " +
+                                       std::to_string(body.size()) + "\r\n\r\n" + body;
+                for (size_t sent = 0; sent < response.size();)
+                {
+                    ssize_t n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+                    if (n <= 0)
+                        break;
+                    sent += n;
+                }
+            }
+            close(client);
+        }
+    }
+};
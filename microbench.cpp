@@ -0,0 +1,216 @@
+/**
+ * PirTimer
+ * microbench.cpp
+ * Purpose: Measures ns/op and allocations/op of the helpers on the motion path
+ * Dependencies: animation.hpp, curve.hpp, lifxreply.hpp, metrics.hpp, pirtimer.hpp, schedule.hpp, spsc.hpp, timer.hpp, projects/Pirtimer/packet.cpp
+ *
+ * Runs in a scratch directory so config() and log() touch their real files
+ * without clobbering the ones next to the binary.
+ *
+ * Usage: ./microbench [-t ms per benchmark]
+*/
+
+#include "animation.hpp"
+#include "curve.hpp"
+#include "lifxreply.hpp"
+#include "metrics.hpp"
+#include "pirtimer.hpp"
+#include "projects/Pirtimer/packet.h"
+#include "schedule.hpp"
+#include "spsc.hpp"
+#include "timer.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <netinet/in.h>
+#include <new>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static std::atomic<uint64_t> allocations{0};
+
+/// Where results go, since log() echoes to cout and cout is silenced
+static std::ostream results(std::cout.rdbuf());
+
+void *operator new(size_t size)
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+/// Keep the optimizer from throwing away a result
+template <typename T>
+inline void keep(T const &value) { asm volatile("" : : "r,m"(value) : "memory"); }
+
+/// Run a function repeatedly for a while and print its cost per call
+/// @param name The name to print
+/// @param budget How long to keep calling it
+/// @param func The operation to measure
+void bench(const std::string &name, std::chrono::milliseconds budget, const std::function<void()> &func)
+{
+  using Clock = std::chrono::steady_clock;
+
+  for (int i = 0; i < 10; i++) // Warm up caches and lazily created state
+    func();
+
+  uint64_t ops = 0;
+  uint64_t batch = 1;
+  auto allocsBefore = allocations.load();
+  auto begin = Clock::now();
+  auto elapsed = Clock::duration::zero();
+  while (elapsed < budget)
+  {
+    for (uint64_t i = 0; i < batch; i++)
+      func();
+    ops += batch;
+    batch *= 2;
+    elapsed = Clock::now() - begin;
+  }
+  auto allocs = allocations.load() - allocsBefore;
+
+  results << std::left << std::setw(28) << name << std::right << std::fixed
+          << std::setw(12) << ops << " ops"
+          << std::setprecision(1) << std::setw(14) << std::chrono::duration<double, std::nano>(elapsed).count() / ops << " ns/op"
+          << std::setprecision(2) << std::setw(10) << (double)allocs / ops << " allocs/op" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  std::chrono::milliseconds budget{500};
+
+  int opt;
+  while ((opt = getopt(argc, argv, "t:")) != -1)
+  {
+    switch (opt)
+    {
+    case 't':
+      budget = std::chrono::milliseconds(std::stoi(optarg));
+      break;
+    default:
+      std::cerr << "Usage: " << argv[0] << " [-t ms per benchmark]" << std::endl;
+      return 1;
+    }
+  }
+
+  char dirTemplate[] = "/tmp/pirtimer-microbench-XXXXXX";
+  if (!mkdtemp(dirTemplate))
+  {
+    perror("mkdtemp");
+    return 1;
+  }
+  std::string dir = dirTemplate;
+  if (chdir(dir.c_str()) != 0)
+  {
+    perror("chdir");
+    return 1;
+  }
+  std::ofstream("timeout.val") << 20;
+
+  // log() echoes everything to cout, which is not what is being measured
+  std::ofstream devnull("/dev/null");
+  std::cout.rdbuf(devnull.rdbuf());
+
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in listener{};
+  listener.sin_family = AF_INET;
+  listener.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(listener);
+  if (sock < 0 || bind(sock, (sockaddr *)&listener, length) < 0 || getsockname(sock, (sockaddr *)&listener, &length) < 0)
+  {
+    perror("listener");
+    return 1;
+  }
+  uint16_t port = ntohs(listener.sin_port);
+
+  char packet[42] = {0};
+  uint8_t rawPacket[packetSize] = {0};
+  uint16_t brightness = 0;
+
+  bench("buildPacket", budget, [&] {
+    buildPacket(brightness ^= UINT16_MAX, 0, packet);
+    keep(packet);
+  });
+  bench("buildPacket (projects)", budget, [&] {
+    buildPacket(brightness ^= UINT16_MAX, 0, rawPacket);
+    keep(rawPacket);
+  });
+
+  uint8_t strip[lifxSetExtendedColorZonesSize];
+  auto frames = Animation::rainbow(lifxMaxZones, 2, UINT16_MAX);
+  lifxSetExtendedColorZones(strip, frames.data(), lifxMaxZones, 100);
+  size_t frame = 0;
+  bench("Animation frame (82 zones)", budget, [&] {
+    lifxPutZones(strip, &frames[(frame ^= 1) * lifxMaxZones], lifxMaxZones);
+    keep(strip);
+  });
+
+  uint8_t reply[lifxHeaderSize + LifxLightState::payloadSize] = {};
+  lifxHeader(reply, sizeof(reply), LIFX_LIGHT_STATE, false);
+  memcpy(&reply[lifxHeaderSize + 12], "Hall", 4);
+  bench("LifxView parse (LightState)", budget, [&] {
+    LifxView view;
+    LifxLightState state;
+    if (view.parse(reply, sizeof(reply)) && view.as(state))
+      keep(state.label().size() + state.power());
+  });
+  bench("config", budget, [] { keep(config(TIMEOUT)); });
+  bench("hour", budget, [] { keep(hour()); });
+  Schedule schedule = Schedule::daily(11, 23);
+  bench("Schedule::active", budget, [&] { keep(schedule.active()); });
+
+  auto curve = DayCurve::parse("07:00/100/5000,20:00/80/3500,23:00/30/2700");
+  bench("DayCurve::at", budget, [&] { keep(curve.at().brightness); });
+  SpscQueue<uint64_t, 256> spsc;
+  uint64_t item = 0;
+  bench("SpscQueue push/pop", budget, [&] {
+    spsc.push(item);
+    spsc.pop(item);
+  });
+
+  Counter counter;
+  bench("Counter::inc", budget, [&] { counter.inc(); });
+  Histogram histogram;
+  bench("Histogram::observe", budget, [&] { histogram.observe(std::chrono::microseconds(700)); });
+  bench("log", budget, [] { log("Turning on"); });
+  bench("sendPacket (loopback)", budget, [&] {
+    sendPacket(packet, "127.0.0.1", port);
+    char drain[64];
+    while (recv(sock, drain, sizeof(drain), MSG_DONTWAIT) > 0)
+      ;
+  });
+  bench("sendPacket (localhost, cached)", budget, [&] {
+    sendPacket(packet, "localhost", port);
+    char drain[64];
+    while (recv(sock, drain, sizeof(drain), MSG_DONTWAIT) > 0)
+      ;
+  });
+
+  Timer countdown(std::chrono::minutes(20), [] {});
+  bench("Timer start/stop", budget, [&] {
+    countdown.start();
+    countdown.stop();
+  });
+
+  TimerQueue queue;
+  auto id = queue.add({{std::chrono::minutes(15), [] {}}, {std::chrono::minutes(20), [] {}}});
+  bench("TimerQueue start/stop", budget, [&] {
+    queue.start(id);
+    queue.stop(id);
+  });
+
+  close(sock);
+  unlink("timeout.val");
+  unlink("log.txt");
+  if (chdir("/") == 0)
+    rmdir(dir.c_str());
+  return 0;
+}
@@ -0,0 +1,75 @@
+/**
+ * PirTimer
+ * pirctl.cpp
+ * Purpose: Sends a command to a running pirtimer over its control socket and prints the reply
+ * Dependencies: control.hpp, pirtimer started with -c
+ *
+ * Commands:
+ *   status                     One line per zone with its state
+ *   on <zone> | off <zone>     Switch a zone's lights by hand
+ *   timeout <zone> <duration>  Change a zone's countdown, minutes unless it ends in ms, s or m
+ *   reload                     Read zones.val, schedule.val and the .val files again
+ *   metrics                    The metrics, in Prometheus text format
+ *
+ * Usage: ./pirctl [-S socket path] command [arguments]...
+*/
+
+#include "control.hpp"
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+int main(int argc, char **argv)
+{
+  std::string path = defaultControlPath;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "+S:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'S':
+      path = optarg;
+      break;
+    default:
+      optind = argc + 1; // Fall through to the usage below
+    }
+  }
+  if (optind >= argc)
+  {
+    std::cerr << "Usage: " << argv[0] << " [-S socket path] status | on <zone> | off <zone> | timeout <zone> <duration> | reload | metrics" << std::endl;
+    return 1;
+  }
+
+  std::string message;
+  for (int i = optind; i < argc; i++)
+    message += std::string(i > optind ? " " : "") + argv[i];
+
+  sockaddr_un address;
+  controlAddress(path, address);
+  int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (sock < 0 || connect(sock, (sockaddr *)&address, sizeof(address)) < 0)
+  {
+    perror(path.c_str());
+    return 1;
+  }
+  if (send(sock, message.data(), message.size(), 0) < 0)
+  {
+    perror("send");
+    return 1;
+  }
+
+  std::string reply(maxControlMessage, '\0');
+  ssize_t length = recv(sock, &reply[0], reply.size(), 0);
+  close(sock);
+  if (length <= 0)
+  {
+    std::cerr << "No reply from pirtimer" << std::endl;
+    return 1;
+  }
+  reply.resize(length);
+  std::cout << reply;
+  return reply.compare(0, 6, "error:") == 0 ? 1 : 0;
+}
@@ -2,219 +2,316 @@
  * PirTimer
  * pirtimer.cpp
  * Purpose: Is an interface between a motion sensor GPIO module and a lifx lightbulb with a timeout function
- * Dependencies: timer.hpp, GPIO.hpp, sendpacket.hpp
+ * Dependencies: timer.hpp, GPIO.hpp, control.hpp, metrics.hpp, pirtimer.hpp, rules.hpp, schedule.hpp, spsc.hpp
+ * Signals: SIGHUP reloads the zones like "pirctl reload", SIGTERM and SIGINT shut down cleanly
  * 
  * @author Elias Floreteng
  * @version 1.2 30/03/2020
 */
 
 #include "GPIO.hpp"
-#include "sendpacket.hpp"
+#include "control.hpp"
+#include "metrics.hpp"
+#include "pirtimer.hpp"
+#include "rules.hpp"
+#include "schedule.hpp"
+#include "spsc.hpp"
 #include "timer.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
 #include <cstring>
-#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <poll.h>
 #include <string>
-#include <time.h>
-
-/// Set onboard LED to a specific state
-/// @param powerLevel The state to set the LED to
-/// @return Error code: 0 on success
-int pwrLed(bool powerLevel);
-
-/// Make a packet for changing a lifx bulb's state
-/// @param brightness The brightness to set the light to: Between 0 and UINT16_MAX
-/// @param delay The time for the change to be executed in: Between 0 and UINT32_MAX
-/// @param packet The packet variable to store the built packet in
-/// @return Error code: 0 on success
-int buildPacket(uint16_t brightness, uint32_t delay, char *packet);
-
-/// Print to cout with prepended timestamp
-/// @param input String to be logged/printed
-/// @return Error code: 0 on success
-int log(std::string input);
-
-/// Get the current time
-/// @return The current time in fractional hours
-double hour();
-
-typedef enum
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+int main(int argc, char **argv)
 {
-  TIMEOUT,
-  STARTTIME,
-  STOPTIME
-} ConfigKey;
+  std::vector<Target> targets;
+  bool jitter = false;
+  std::string metricsAt;
+  std::string controlAt;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:t:jm:c:")) != -1)
+  {
+    switch (opt)
+    {
+    case 's': // Run without a Pi, reading the PIR from a fake sysfs tree
+      GPIO::setMode(GPIO_MODE_SIMULATED);
+      GPIO::setDirectory(std::string(optarg) + "/");
+      break;
+    case 't': // Replace the default lights, can be given several times. "broadcast" or a subnet broadcast address reaches them all in one packet
+      targets.push_back(parseTarget(optarg));
+      break;
+    case 'j': // Log how late every countdown fires
+      jitter = true;
+      break;
+    case 'm': // Serve metrics on a loopback port or a Unix socket path
+      metricsAt = optarg;
+      break;
+    case 'c': // Take commands from pirctl on a Unix socket
+      controlAt = optarg;
+      break;
+    default:
+      std::cerr << "Usage: " << argv[0] << " [-s simulated gpio directory] [-t host[:port] | broadcast]... [-j] [-m port | socket path] [-c control socket path]" << std::endl;
+      return 1;
+    }
+  }
 
-/// Get the a file value corresponding to the key
-/// @param key The config value to retrieve
-/// @return The config value
-double config(ConfigKey key);
+  // Blocked before any thread starts so every thread inherits the mask, and the signals
+  // only arrive through the signalfd the main thread waits on next to the PIRs
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGHUP);
+  int sigfd = -1;
+  if (sigprocmask(SIG_BLOCK, &signals, nullptr) < 0 || (sigfd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+  {
+    perror("signalfd");
+    return 1;
+  }
 
-int main(/* int argc, char **argv */)
-{
   std::cout << "Program started" << std::endl;
 
   remove("log.txt");
 
   log("Log entry started");
 
-  auto bulbIp = "192.168.1.92";
-  auto stipIp = "192.168.1.174";
+  if (targets.empty())
+  {
+    targets.push_back(parseTarget("192.168.1.92"));  // Bulb
+    targets.push_back(parseTarget("192.168.1.174")); // Strip
+  }
 
   log("TIMEOUT value: " + std::to_string(config(TIMEOUT)));
   log("STARTTIME value: " + std::to_string(config(STARTTIME)));
   log("STOPTIME value: " + std::to_string(config(STOPTIME)));
 
-  bool sensor = true;
+  // Read at startup and again on the reload command
+  auto loadZones = [&targets] {
+    // schedule.val holds windows per weekday, otherwise STARTTIME/STOPTIME apply every day
+    auto schedule = std::make_shared<Schedule>();
+    if (Schedule::load("./schedule.val", *schedule))
+      log("Using weekly schedule from schedule.val");
+    else
+      *schedule = Schedule::daily(config(STARTTIME), config(STOPTIME));
+
+    // TIMEOUT is in minutes, fractions included
+    using Minutes = std::chrono::duration<double, std::ratio<60>>;
+
+    // Without zones.val there is one zone: the PIR on GPIO 17 and the default lights
+    ZoneConfig defaults;
+    defaults.name = "default";
+    defaults.pins = {17};
+    defaults.targets = targets;
+    defaults.timeout = std::chrono::duration_cast<std::chrono::steady_clock::duration>(Minutes(config(TIMEOUT)));
+    defaults.schedule = schedule;
+
+    std::vector<ZoneConfig> zones{defaults};
+    if (Rules::load("./zones.val", defaults, zones))
+      log("Using " + std::to_string(zones.size()) + " zones from zones.val");
+    return zones;
+  };
 
-  char packet[42] = {0};
-  auto pir = GPIO::openGPIO(17, GPIO_INPUT);
+  Rules rules;
+  rules.compile(loadZones());
+  TimerStats timerStats;
+  if (jitter)
+    rules.instrument(&timerStats);
 
-  Timer countdown(config(TIMEOUT), [&] {
-    if (!pir->read())
+  std::unique_ptr<MetricsServer> metricsServer;
+  if (!metricsAt.empty())
+  {
+    metricsServer.reset(new MetricsServer(metricsAt));
+    log("Serving metrics on " + metricsAt);
+  }
+  Metrics &metrics = Metrics::shared();
+
+  std::vector<std::shared_ptr<GPIO>> pirs;
+  for (auto pin : rules.pins())
+    pirs.push_back(GPIO::openGPIO(pin, GPIO_INPUT));
+
+  // This thread only reads edges; deciding, logging and sending happen on the actuator
+  // thread, so a slow bulb or disk cannot make the next edge wait
+  struct EdgeEvent
+  {
+    int32_t pin;
+    GPIOEdge edge;
+    std::chrono::steady_clock::time_point read;
+  };
+  SpscQueue<EdgeEvent, 256> events;
+  int wake = eventfd(0, EFD_CLOEXEC);
+  if (wake < 0)
+  {
+    perror("eventfd");
+    return 1;
+  }
+  // Set by the main thread on a signal, acted on by the actuator thread once it wakes
+  std::atomic<bool> reloadRequested{false};
+  std::atomic<bool> stopping{false};
+
+  auto reload = [&] {
+    auto zones = loadZones();
+    std::vector<int32_t> pins;
+    for (auto &config : zones)
+      pins.insert(pins.end(), config.pins.begin(), config.pins.end());
+    std::sort(pins.begin(), pins.end());
+    if (pins != rules.pins())
+      throw std::runtime_error("the zones use other pins now, restart pirtimer to apply them");
+    rules.compile(zones);
+    rules.startCountdowns();
+    log("Reloaded " + std::to_string(rules.size()) + " zones");
+  };
+
+  // Commands from pirctl, run on the actuator thread between edges
+  auto command = [&](const std::vector<std::string> &words) -> std::string {
+    auto zone = [&]() -> Zone & {
+      Zone *found = (words.size() > 1) ? rules.find(words[1]) : nullptr;
+      if (!found)
+        throw std::runtime_error("no such zone");
+      return *found;
+    };
+    if (words[0] == "status")
+      return rules.status();
+    if (words[0] == "on" || words[0] == "off")
     {
-      if ((hour() > config(STARTTIME) && hour() < config(STOPTIME)) || sensor)
-      {
-        log("Turning off");
-        buildPacket(0, 0, packet);
-        sendPacket(packet, bulbIp);
-        sendPacket(packet, stipIp);
-      }
+      rules.force(zone(), words[0] == "on");
+      return "ok\n";
     }
-  });
-
-  while (true)
+    if (words[0] == "timeout" && words.size() == 3)
+    {
+      // Minutes like timeout.val, unless it ends in ms, s or m
+      rules.setTimeout(zone(), std::chrono::duration_cast<std::chrono::steady_clock::duration>(Rules::parseDuration(words[2], 60)));
+      return "ok\n";
+    }
+    if (words[0] == "reload")
+    {
+      reload();
+      return "ok\n";
+    }
+    if (words[0] == "metrics")
+      return metrics.render();
+    return "error: unknown command, use status | on <zone> | off <zone> | timeout <zone> <duration> | reload | metrics\n";
+  };
+  std::unique_ptr<ControlServer> control;
+  if (!controlAt.empty())
   {
-    switch (pir->waitForAnyEdge())
+    control.reset(new ControlServer(controlAt, command));
+    log("Taking commands on " + controlAt);
+  }
+
+  std::thread actuator([&] {
+    std::vector<pollfd> fds;
+    while (true)
     {
-    case GPIO_EDGE_RISING: // When motion is detected
-      if (!countdown.isRunning())
+      fds.assign(1, {wake, POLLIN, 0});
+      if (control)
+        control->addPollFds(fds);
+      if (poll(fds.data(), fds.size(), -1) < 0)
       {
-        if (hour() > config(STARTTIME) && hour() < config(STOPTIME))
+        if (errno == EINTR)
+          continue;
+        perror("poll");
+        return;
+      }
+      uint64_t count;
+      if ((fds[0].revents & POLLIN) && ::read(wake, &count, sizeof(count)) == sizeof(count))
+      {
+        EdgeEvent event;
+        while (events.pop(event))
         {
-          sensor = true;
-          log("Turning on");
-          pwrLed(true);
-          buildPacket(UINT16_MAX, 0, packet);
-          sendPacket(packet, bulbIp);
-          sendPacket(packet, stipIp);
+          TRACE_SCOPE("edge");
+          rules.onEdge(event.pin, event.edge);
+          metrics.edgeHandling.observe(std::chrono::steady_clock::now() - event.read);
         }
-        else if (sensor)
+        // The edges queued before the signal have been handled above
+        if (stopping.load())
+          return;
+        if (reloadRequested.exchange(false))
         {
-          sensor = false;
-          log("Turning on for last time");
-          pwrLed(false);
-          buildPacket(UINT16_MAX, 0, packet);
-          sendPacket(packet, bulbIp);
-          sendPacket(packet, stipIp);
+          try
+          {
+            reload();
+          }
+          catch (const std::exception &e)
+          {
+            log(std::string("Reload failed: ") + e.what());
+          }
         }
       }
-      // log("Resetting timer");
-      countdown.stop();
-      break;
-
-    case GPIO_EDGE_FALLING: // Start timer
-      // log("Starting timer");
-      countdown.start(config(TIMEOUT));
-      break;
-    default:
-      break;
+      if (control)
+        control->handle(&fds[1]);
     }
-  }
-  return 0;
-}
+  });
 
-int buildPacket(uint16_t brightness, uint32_t delay, char *packet)
-{
-  std::stringstream brightnessStream;
-  brightnessStream << std::setfill('0') << std::setw(4) << std::right << std::hex << __builtin_bswap16(brightness);
-  std::stringstream delayStream;
-  delayStream << std::setfill('0') << std::setw(8) << std::right << std::hex << __builtin_bswap32(delay);
-
-  packet[0] = 0x2a;
-  packet[3] = 0x34;
-  packet[4] = 0xb4;
-  packet[5] = 0x3c;
-  packet[6] = 0xf0;
-  packet[7] = 0x84;
-  packet[22] = 0x01;
-  packet[23] = 0x0d;
-  packet[32] = 0x75;
-  packet[36] = std::stoul("0x" + brightnessStream.str().substr(2, 2), nullptr, 16);
-  packet[37] = std::stoul("0x" + brightnessStream.str().substr(4, 2), nullptr, 16);
-  packet[38] = std::stoul("0x" + delayStream.str().substr(2, 2), nullptr, 16);
-  packet[39] = std::stoul("0x" + delayStream.str().substr(4, 2), nullptr, 16);
-  packet[40] = std::stoul("0x" + delayStream.str().substr(6, 2), nullptr, 16);
-  packet[41] = std::stoul("0x" + delayStream.str().substr(8, 2), nullptr, 16);
-
-  return 0;
-}
-
-int pwrLed(bool powerLevel)
-{
-  std::ofstream fs;
-  fs.open("/sys/class/leds/led0/brightness");
-  fs << (powerLevel ? "0" : "255");
-  return 0;
-}
+  auto wakeActuator = [&] {
+    uint64_t one = 1;
+    if (write(wake, &one, sizeof(one)) != sizeof(one))
+      perror("eventfd");
+  };
 
-double config(ConfigKey key)
-{
-  std::string filename;
-  switch (key)
+  int status = 0;
+  while (true)
   {
-  case TIMEOUT:
-    filename = "timeout";
-    break;
-  case STARTTIME:
-    filename = "start";
-    break;
-  case STOPTIME:
-    filename = "stop";
+    GPIOEdge edge;
+    std::shared_ptr<GPIO> pir;
+    try
+    {
+      pir = GPIO::waitForAnyEdge(pirs, edge, -1, sigfd);
+    }
+    catch (const std::exception &e)
+    {
+      // Not a signal: the pins cannot be waited on any more, so shut down the same way
+      log(std::string("Shutting down: ") + e.what());
+      status = 1;
+      stopping = true;
+      wakeActuator();
+      break;
+    }
+    if (pir)
+    {
+      metrics.edges.inc();
+      if (!events.push({pir->getNumber(), edge, std::chrono::steady_clock::now()}))
+      {
+        metrics.edgesDropped.inc();
+        continue;
+      }
+      wakeActuator();
+      continue;
+    }
+
+    // Non-blocking, in case the wait returned without a signal after all
+    signalfd_siginfo info;
+    if (::read(sigfd, &info, sizeof(info)) != sizeof(info))
+      continue;
+    if (info.ssi_signo == SIGHUP)
+    {
+      log("Reload requested");
+      reloadRequested = true;
+      wakeActuator();
+      continue;
+    }
+    log(std::string("Shutting down on ") + strsignal(info.ssi_signo));
+    stopping = true;
+    wakeActuator();
     break;
   }
-  std::ifstream fs;
-  fs.open("./" + filename + ".val");
-  if (fs.is_open())
-  {
-    double num = 0;
-    fs >> num;
-    return num;
-  }
-  else
-  {
-    std::cerr << "Error opening file" << std::endl;
-    return -1;
-  }
-}
-
-double hour()
-{
-  time_t now = time(0);
-  tm *ltm = localtime(&now);
-
-  double minute = (double)(ltm->tm_min) / (double)60;
-  double hourDecimal = ltm->tm_hour + minute;
-  return hourDecimal;
-}
-
-int log(std::string input)
-{
-  char message[input.size() + 1];
-  strcpy(message, input.c_str());
-
-  char buff[20];
-  struct tm *sTm;
-
-  time_t now = time(0);
-  sTm = localtime(&now);
-
-  strftime(buff, sizeof(buff), "%Y-%m-%d %H:%M:%S", sTm);
-  std::cout << message << std::endl;
 
-  ofstream logfile{"log.txt", std::ios_base::app};
-  if (logfile.is_open())
-    logfile << "[" << buff << "] " << message << std::endl;
-  logfile.close();
-  return 0;
+  // The actuator finishes the queued edges first. Leaving main then stops the control and
+  // metrics sockets, unexports the pins and joins the countdown and animation threads.
+  actuator.join();
+  close(wake);
+  close(sigfd);
+  log("Stopped");
+  return status;
 }
\ No newline at end of file
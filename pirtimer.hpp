@@ -0,0 +1,198 @@
+/**
+ * PirTimer
+ * pirtimer.hpp
+ * Purpose: The helpers pirtimer.cpp is built from: packets, config values, time and logging
+ * Dependencies: sendpacket.hpp
+ *
+ * @author Elias Floreteng
+ * @version 1.2 30/03/2020
+*/
+
+#pragma once
+
+#include "breaker.hpp"
+#include "lifx.hpp"
+#include "metrics.hpp"
+#include "sendpacket.hpp"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <time.h>
+#include <vector>
+
+/// Set onboard LED to a specific state
+/// @param powerLevel The state to set the LED to
+/// @return Error code: 0 on success
+int pwrLed(bool powerLevel);
+
+/// Make a packet for changing a lifx bulb's state
+/// @param brightness 0 turns the light off and anything else turns it on: SetPower has no levels in between
+/// @param delay The time for the change to be executed in: Between 0 and UINT32_MAX milliseconds
+/// @param packet The packet variable to store the built packet in, lifxSetPowerSize bytes
+/// @return Error code: 0 on success
+int buildPacket(uint16_t brightness, uint32_t delay, char *packet);
+
+/// Print to cout with prepended timestamp
+/// @param input String to be logged/printed
+/// @return Error code: 0 on success
+int log(std::string input);
+
+/// A lifx device to send packets to
+struct Target
+{
+  std::string host;
+  uint16_t port;
+  /// Shared by every Target for the same bulb
+  CircuitBreaker *breaker;
+  /// Whether it is a multizone strip, the only kind of light effects are played on
+  bool multizone = false;
+};
+
+/// Parse a "host" or "host:port" command line argument. The host "broadcast" stands for
+/// 255.255.255.255, which like a subnet broadcast address such as 192.168.1.255 sends each
+/// packet once for every bulb to act on (the packets are tagged, i.e. for all devices).
+/// @param arg The argument to parse
+/// @return The target, using the default lifx port if none is given
+Target parseTarget(std::string arg);
+
+/// Send a packet to every target, skipping those whose circuit breaker is open
+/// @param packet The packet to send
+/// @param targets The devices to send it to
+/// @return The number of targets that failed or were skipped: 0 on success
+template <typename T, size_t N>
+int sendAll(T (&packet)[N], const std::vector<Target> &targets);
+
+/// Get the current time
+/// @return The current time in fractional hours
+double hour();
+
+typedef enum
+{
+  TIMEOUT,
+  STARTTIME,
+  STOPTIME
+} ConfigKey;
+
+/// Get the a file value corresponding to the key
+/// @param key The config value to retrieve
+/// @return The config value
+double config(ConfigKey key);
+
+int buildPacket(uint16_t brightness, uint32_t delay, char *packet)
+{
+  lifxSetPower((uint8_t *)packet, brightness ? UINT16_MAX : 0, delay);
+  return 0;
+}
+
+Target parseTarget(std::string arg)
+{
+  auto colon = arg.rfind(':');
+  Target target{arg.substr(0, colon), 56700, nullptr};
+  if (colon != std::string::npos)
+    target.port = (uint16_t)std::stoul(arg.substr(colon + 1));
+  if (target.host == "broadcast")
+    target.host = "255.255.255.255";
+  target.breaker = &CircuitBreaker::of(target.host + ":" + std::to_string(target.port));
+  return target;
+}
+
+template <typename T, size_t N>
+int sendAll(T (&packet)[N], const std::vector<Target> &targets)
+{
+  Metrics &metrics = Metrics::shared();
+  auto started = std::chrono::steady_clock::now();
+  int failed = 0;
+  for (auto &target : targets)
+  {
+    if (!target.breaker->allow())
+    {
+      failed++;
+      metrics.sendsSkipped.inc();
+    }
+    else if (sendPacket(packet, target.host.c_str(), target.port) == 0)
+    {
+      metrics.packetsSent.inc();
+      if (target.breaker->success())
+        log("Reached " + target.host + " again");
+    }
+    else
+    {
+      failed++;
+      metrics.sendFailures.inc();
+      if (target.breaker->failure())
+        log("Cannot reach " + target.host + ", skipping it for now");
+    }
+  }
+  metrics.sendDuration.observe(std::chrono::steady_clock::now() - started);
+  return failed;
+}
+
+int pwrLed(bool powerLevel)
+{
+  std::ofstream fs;
+  fs.open("/sys/class/leds/led0/brightness");
+  fs << (powerLevel ? "0" : "255");
+  return 0;
+}
+
+double config(ConfigKey key)
+{
+  std::string filename;
+  switch (key)
+  {
+  case TIMEOUT:
+    filename = "timeout";
+    break;
+  case STARTTIME:
+    filename = "start";
+    break;
+  case STOPTIME:
+    filename = "stop";
+    break;
+  }
+  std::ifstream fs;
+  fs.open("./" + filename + ".val");
+  if (fs.is_open())
+  {
+    double num = 0;
+    fs >> num;
+    return num;
+  }
+  else
+  {
+    std::cerr << "Error opening file" << std::endl;
+    return -1;
+  }
+}
+
+double hour()
+{
+  time_t now = time(0);
+  tm *ltm = localtime(&now);
+
+  double minute = (double)(ltm->tm_min) / (double)60;
+  double hourDecimal = ltm->tm_hour + minute;
+  return hourDecimal;
+}
+
+int log(std::string input)
+{
+  char message[input.size() + 1];
+  strcpy(message, input.c_str());
+
+  char buff[20];
+  struct tm *sTm;
+
+  time_t now = time(0);
+  sTm = localtime(&now);
+
+  strftime(buff, sizeof(buff), "%Y-%m-%d %H:%M:%S", sTm);
+  std::cout << message << std::endl;
+
+  std::ofstream logfile{"log.txt", std::ios_base::app};
+  if (logfile.is_open())
+    logfile << "[" << buff << "] " << message << std::endl;
+  logfile.close();
+  return 0;
+}
@@ -27,18 +27,21 @@ int main(/* int argc, char **argv */)
 
 	bool sensor = true;
 
-	uint8_t packet[42] = { 0 };
+	uint8_t packet[packetSize] = { 0 };
 	auto pir = GPIO::openGPIO(17, GPIO_INPUT);
 
-	Timer countdown(std::chrono::minutes((uint32_t)std::round(config(TIMEOUT))), [&] {
+	// TIMEOUT is in minutes, fractions included
+	using Minutes = std::chrono::duration<double, std::ratio<60>>;
+
+	Timer countdown(Minutes(config(TIMEOUT)), [&] {
 		if (!pir->read())
 		{
 			if ((hour() > config(STARTTIME) && hour() < config(STOPTIME)) || sensor)
 			{
 				log("Turning off");
 				buildPacket(0, 0, packet);
-				sendPacket(packet, bulbIp);
-				sendPacket(packet, stipIp);
+				sendPacket(packet, packetSize, bulbIp);
+				sendPacket(packet, packetSize, stipIp);
 			}
 		}
 		});
@@ -56,8 +59,8 @@ int main(/* int argc, char **argv */)
 					log("Turning on");
 					//pwrLed(true);
 					buildPacket(UINT16_MAX, 0, packet);
-					sendPacket(packet, bulbIp);
-					sendPacket(packet, stipIp);
+					sendPacket(packet, packetSize, bulbIp);
+					sendPacket(packet, packetSize, stipIp);
 				}
 				else if (sensor)
 				{
@@ -65,8 +68,8 @@ int main(/* int argc, char **argv */)
 					log("Turning on for last time");
 					//pwrLed(false);
 					buildPacket(UINT16_MAX, 0, packet);
-					sendPacket(packet, bulbIp);
-					sendPacket(packet, stipIp);
+					sendPacket(packet, packetSize, bulbIp);
+					sendPacket(packet, packetSize, stipIp);
 				}
 			}
 			// log("Resetting timer");
@@ -75,7 +78,7 @@ int main(/* int argc, char **argv */)
 
 		case GPIO_EDGE_FALLING: // Start timer
 		  // log("Starting timer");
-			countdown.start(std::chrono::minutes((uint32_t)std::round(config(TIMEOUT))));
+			countdown.start(Minutes(config(TIMEOUT)));
 			break;
 		default:
 			break;
@@ -84,37 +87,6 @@ int main(/* int argc, char **argv */)
 	return 0;
 }
 
-int buildPacket(uint16_t brightness, uint32_t delay, uint8_t* packet)
-{
-	/*std::stringstream brightnessStream;
-	brightnessStream << std::setfill('0') << std::setw(4) << std::right << std::hex << __builtin_bswap16(brightness);
-	std::stringstream delayStream;
-	delayStream << std::setfill('0') << std::setw(8) << std::right << std::hex << __builtin_bswap32(delay);*/
-	auto swpbrightness = __builtin_bswap16(brightness);
-	auto swpdelay = __builtin_bswap32(delay);
-
-	packet[0] = sizeof(packet);
-	packet[3] = 0x34;
-	packet[4] = 0xb4;
-	packet[5] = 0x3c;
-	packet[6] = 0xf0;
-	packet[7] = 0x84;
-	packet[22] = 0x01;
-	packet[23] = 0x0d;
-	packet[32] = 0x75;
-	memcpy(&packet[36], &swpbrightness, sizeof(brightness));
-	memcpy(&packet[38], &swpdelay, sizeof(delay));
-
-	/*packet[36] = std::stoul("0x" + brightnessStream.str().substr(2, 2), nullptr, 16);
-	packet[37] = std::stoul("0x" + brightnessStream.str().substr(4, 2), nullptr, 16);
-	packet[38] = std::stoul("0x" + delayStream.str().substr(2, 2), nullptr, 16);
-	packet[39] = std::stoul("0x" + delayStream.str().substr(4, 2), nullptr, 16);
-	packet[40] = std::stoul("0x" + delayStream.str().substr(6, 2), nullptr, 16);
-	packet[41] = std::stoul("0x" + delayStream.str().substr(8, 2), nullptr, 16);*/
-
-	return 0;
-}
-
 int pwrLed(bool powerLevel)
 {
 	std::ofstream fs;
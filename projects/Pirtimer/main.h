@@ -1,6 +1,7 @@
 #pragma once
 
 #include "GPIO.h"
+#include "packet.h"
 #include "sendpacket.h"
 #include "timer.h"
 #include <cstring>
@@ -17,13 +18,6 @@ std::string configLocation = "/etc/pirtimer/";
 /// @return Error code: 0 on success
 int pwrLed(bool powerLevel);
 
-/// Make a packet for changing a lifx bulb's state
-/// @param brightness The brightness to set the light to: Between 0 and UINT16_MAX
-/// @param delay The time for the change to be executed in: Between 0 and UINT32_MAX
-/// @param packet The packet variable to store the built packet in
-/// @return Error code: 0 on success
-int buildPacket(uint16_t brightness, uint32_t delay, uint8_t* packet);
-
 /// Print to cout with prepended timestamp
 /// @param input String to be logged/printed
 /// @return Error code: 0 on success
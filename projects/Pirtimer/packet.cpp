@@ -0,0 +1,21 @@
+#include "packet.h"
+
+int buildPacket(uint16_t brightness, uint32_t delay, uint8_t* packet)
+{
+	auto swpbrightness = __builtin_bswap16(brightness);
+	auto swpdelay = __builtin_bswap32(delay);
+
+	packet[0] = packetSize;
+	packet[3] = 0x34;
+	packet[4] = 0xb4;
+	packet[5] = 0x3c;
+	packet[6] = 0xf0;
+	packet[7] = 0x84;
+	packet[22] = 0x01;
+	packet[23] = 0x0d;
+	packet[32] = 0x75;
+	memcpy(&packet[36], &swpbrightness, sizeof(brightness));
+	memcpy(&packet[38], &swpdelay, sizeof(delay));
+
+	return 0;
+}
\ No newline at end of file
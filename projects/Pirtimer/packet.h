@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+/// The length of a SetPower packet: a 36 byte header and a 6 byte payload
+constexpr uint8_t packetSize = 42;
+
+/// Make a packet for changing a lifx bulb's state
+/// @param brightness The brightness to set the light to: Between 0 and UINT16_MAX
+/// @param delay The time for the change to be executed in: Between 0 and UINT32_MAX
+/// @param packet The packet variable to store the built packet in, packetSize bytes long
+/// @return Error code: 0 on success
+int buildPacket(uint16_t brightness, uint32_t delay, uint8_t* packet);
\ No newline at end of file
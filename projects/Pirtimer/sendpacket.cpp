@@ -2,7 +2,7 @@
 
 //template <typename T, size_t N>
 //int sendPacket(T(&buffer)[N], const char* ip)
-int sendPacket(uint8_t* buffer, const char* ip)
+int sendPacket(uint8_t* buffer, size_t size, const char* ip)
 {
 	int sock, n;
 	unsigned int length;
@@ -10,11 +10,11 @@ int sendPacket(uint8_t* buffer, const char* ip)
 	struct hostent* hp;
 	hp = gethostbyname(ip);
 	if (hp == 0)
-		senderror("Unknown host");
+		return senderror("Unknown host");
 
 	sock = socket(AF_INET, SOCK_DGRAM, 0);
 	if (sock < 0)
-		senderror("socket");
+		return senderror("socket");
 
 	server.sin_family = AF_INET;
 	bcopy((char*)hp->h_addr,
@@ -23,17 +23,17 @@ int sendPacket(uint8_t* buffer, const char* ip)
 	server.sin_port = htons(56700);
 	length = sizeof(struct sockaddr_in);
 
-	n = sendto(sock, buffer, sizeof(buffer), 0, (const struct sockaddr*)&server, length);
-	if (n < 0)
-		senderror("Sendto");
+	n = sendto(sock, buffer, size, 0, (const struct sockaddr*)&server, length);
 	// printf("Sending Packet...\n");
 
 	close(sock);
+	if (n < 0)
+		return senderror("Sendto");
 	return 0;
 }
 
-void senderror(const char* msg)
+int senderror(const char* msg)
 {
 	perror(msg);
-	exit(1);
+	return -1;
 }
\ No newline at end of file
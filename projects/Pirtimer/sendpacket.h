@@ -14,7 +14,11 @@
 #include <string>
 #include <pthread.h>
 
-void senderror(const char* msg);
+/// Report a failed send without exiting, the caller carries on with the next bulb
+/// @return -1
+int senderror(const char* msg);
 //template <typename T, size_t N>
 //int sendPacket(T(&buffer)[N], const char* ip);
-int sendPacket(uint8_t* buffer, const char* ip);
\ No newline at end of file
+/// @param size The length of the packet in bytes
+/// @return Error code: 0 on success, -1 on failure
+int sendPacket(uint8_t* buffer, size_t size, const char* ip);
\ No newline at end of file
@@ -3,17 +3,16 @@
 void Timer::worker()
 {
 	std::unique_lock<std::mutex> guard(mx);
-	cond.wait_for(guard, timeout);
+	cond.wait_until(guard, deadline, [this] { return !running; });
 	if (running)
 		func();
 	cond.notify_one();
 	running = false;
 }
 
-Timer::Timer(std::chrono::duration<int> waittime, std::function<void()> donefunc)
+Timer::~Timer()
 {
-	timeout = waittime;
-	func = std::move(donefunc);
+	stop();
 }
 
 bool Timer::isRunning()
@@ -21,17 +20,10 @@ bool Timer::isRunning()
 	return running;
 }
 
-void Timer::setTimeout(std::chrono::duration<int> waittime)
+void Timer::start()
 {
-	timeout = waittime;
-}
-
-void Timer::start(std::chrono::duration<int> waittime)
-{
-	if (waittime != std::chrono::minutes(0))
-		timeout = waittime;
-	if (running)
-		stop();
+	stop();
+	deadline = std::chrono::steady_clock::now() + timeout;
 	running = true;
 	t_time = std::thread(&Timer::worker, this);
 }
@@ -40,8 +32,10 @@ void Timer::stop()
 {
 	if (running)
 	{
+		std::lock_guard<std::mutex> guard(mx);
 		running = false;
-		cond.notify_one();
-		t_time.join();
 	}
+	cond.notify_one();
+	if (t_time.joinable())
+		t_time.join();
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <functional>
@@ -7,22 +8,39 @@
 #include <mutex>
 #include <thread>
 
+/// Runs a function once a countdown of any chrono duration runs out, unless stopped first
 class Timer
 {
 private:
 	void worker();
 
-	std::chrono::duration<int> timeout;
-	bool running = false;
+	std::chrono::steady_clock::duration timeout;
+	std::chrono::steady_clock::time_point deadline;
+	std::atomic<bool> running{ false };
 	std::mutex mx;
 	std::condition_variable cond;
 	std::thread t_time;
 	std::function<void()> func;
 public:
-	Timer(std::chrono::duration<int> waittime, std::function<void()> donefunc);
+	template <class Rep, class Period>
+	Timer(std::chrono::duration<Rep, Period> waittime, std::function<void()> donefunc)
+		: timeout(std::chrono::duration_cast<std::chrono::steady_clock::duration>(waittime)), func(std::move(donefunc))
+	{
+	}
+	~Timer();
 
 	bool isRunning();
-	void setTimeout(std::chrono::duration<int> waittime);
-	void start(std::chrono::duration<int> waittime = std::chrono::minutes(0));
+	template <class Rep, class Period>
+	void setTimeout(std::chrono::duration<Rep, Period> waittime)
+	{
+		timeout = std::chrono::duration_cast<std::chrono::steady_clock::duration>(waittime);
+	}
+	template <class Rep, class Period>
+	void start(std::chrono::duration<Rep, Period> waittime)
+	{
+		setTimeout(waittime);
+		start();
+	}
+	void start();
 	void stop();
 };
\ No newline at end of file
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unordered_map>
+
+/// Resolves bulb host names to IPv4 addresses off the motion path. Names are cached for a
+/// fixed time (getaddrinfo() does not report the DNS TTL); after that the old address keeps
+/// being used while a background thread looks the name up again, so a slow or dead DNS
+/// server never delays a packet. Numeric addresses skip the cache entirely.
+class Resolver
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// @param timeToLive How long an address is used before it is looked up again
+    /// @param retryDelay How long to wait before trying again after a failed lookup
+    explicit Resolver(Clock::duration timeToLive = std::chrono::minutes(5), Clock::duration retryDelay = std::chrono::seconds(30))
+        : ttl(timeToLive), retry(retryDelay), t_refresh(&Resolver::worker, this) {}
+
+    ~Resolver()
+    {
+        {
+            std::lock_guard<std::mutex> guard(mx);
+            quit = true;
+        }
+        cond.notify_one();
+        t_refresh.join();
+    }
+
+    /// The resolver sendPacket() uses
+    static Resolver &shared()
+    {
+        static Resolver resolver;
+        return resolver;
+    }
+
+    /// Get the address of a host. Only blocks the first time a name is looked up, or until
+    /// the background thread has answered a prefetch() of it.
+    /// @param host A name or a dotted IPv4 address
+    /// @param address Where to store the address
+    /// @return false if the name is unknown
+    bool lookup(const char *host, in_addr &address)
+    {
+        if (inet_pton(AF_INET, host, &address) == 1)
+            return true;
+
+        std::unique_lock<std::mutex> guard(mx);
+        auto found = cache.find(host);
+        if (found == cache.end())
+        {
+            // Never seen: look it up right here, the caller has nothing to send to otherwise
+            guard.unlock();
+            Entry entry{};
+            entry.valid = resolve(host, entry.address);
+            entry.expires = Clock::now() + (entry.valid ? ttl : retry);
+            entry.looked = true;
+            guard.lock();
+            found = cache.emplace(host, entry).first;
+        }
+        Entry &entry = found->second;
+        done.wait(guard, [&entry] { return entry.looked; });
+        if (Clock::now() >= entry.expires && !entry.refreshing)
+        {
+            entry.refreshing = true;
+            pending.push_back(found->first);
+            cond.notify_one();
+        }
+        address = entry.address;
+        return entry.valid;
+    }
+
+    /// Have the background thread look a host up now, so that sending to it later does not
+    /// have to wait. Never blocks, so it can be called with locks held that sending needs.
+    /// @param host A name or a dotted IPv4 address
+    void prefetch(const std::string &host)
+    {
+        in_addr address;
+        if (inet_pton(AF_INET, host.c_str(), &address) == 1)
+            return;
+
+        std::lock_guard<std::mutex> guard(mx);
+        if (cache.count(host))
+            return;
+        Entry entry{};
+        entry.refreshing = true;
+        cache.emplace(host, entry);
+        pending.push_back(host);
+        cond.notify_one();
+    }
+
+private:
+    struct Entry
+    {
+        in_addr address;
+        Clock::time_point expires;
+        /// Whether address holds anything, i.e. a lookup ever succeeded
+        bool valid;
+        /// Whether it is waiting for the background thread
+        bool refreshing;
+        /// Whether any lookup has finished, so that valid means something
+        bool looked;
+    };
+
+    Clock::duration ttl;
+    Clock::duration retry;
+    std::mutex mx;
+    std::condition_variable cond;
+    /// Notified after every background lookup, for lookup() waiting on a prefetch()
+    std::condition_variable done;
+    std::unordered_map<std::string, Entry> cache;
+    /// Names the background thread should look up again
+    std::deque<std::string> pending;
+    bool quit = false;
+    std::thread t_refresh;
+
+    static bool resolve(const std::string &host, in_addr &address)
+    {
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        addrinfo *result;
+        if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0)
+            return false;
+        address = ((sockaddr_in *)result->ai_addr)->sin_addr;
+        freeaddrinfo(result);
+        return true;
+    }
+
+    void worker()
+    {
+        std::unique_lock<std::mutex> guard(mx);
+        while (true)
+        {
+            cond.wait(guard, [this] { return quit || !pending.empty(); });
+            if (quit)
+                return;
+            std::string host = pending.front();
+            pending.pop_front();
+
+            guard.unlock();
+            in_addr address;
+            bool found = resolve(host, address);
+            guard.lock();
+
+            Entry &entry = cache[host];
+            entry.refreshing = false;
+            entry.looked = true;
+            if (found)
+            {
+                entry.address = address;
+                entry.valid = true;
+            }
+            // A failed lookup keeps the old address, which is most likely still right
+            entry.expires = Clock::now() + (found ? ttl : retry);
+            done.notify_all();
+        }
+    }
+};
@@ -0,0 +1,588 @@
+#pragma once
+
+#include "GPIO.hpp"
+#include "animation.hpp"
+#include "curve.hpp"
+#include "lifx.hpp"
+#include "pirtimer.hpp"
+#include "schedule.hpp"
+#include "timer.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/// How the lights of a zone change when they are switched. The bulbs carry out the
+/// fades themselves: turning on is a SetColor with the brightness and color temperature
+/// followed by a SetPower that fades it in, turning off a single SetPower (or one
+/// SetWaveformOptional for each change with wave).
+struct Scene
+{
+    uint16_t brightness = UINT16_MAX;
+    /// The color temperature to turn on with, sent with the brightness in SetColor
+    uint16_t kelvin = 3500;
+    /// If set, the brightness and color temperature to turn on with, by time of day
+    std::shared_ptr<const DayCurve> curve;
+    /// The brightness the lights dim to as a warning before they turn off
+    uint16_t dim = UINT16_MAX / 4;
+    /// Milliseconds the lights fade in over when motion turns them on
+    uint32_t fadeOn = 0;
+    /// Milliseconds the lights fade out over when the countdown turns them off
+    uint32_t fadeOff = 0;
+    /// Use SetWaveformOptional on the brightness instead of SetPower, for lights that are
+    /// kept powered: "off" is then brightness 0, eased by the waveform over the fade time
+    bool wave = false;
+    LifxWaveform waveform = LIFX_WAVEFORM_HALF_SINE;
+    float cycles = 1;
+    int16_t skew = 0;
+    /// Seconds per turn of a rainbow played on multizone strips while the lights are on, 0 for none
+    double rainbow = 0;
+};
+
+/// How a zone is set up: which sensors switch which lights, and for how long
+struct ZoneConfig
+{
+    std::string name;
+    /// The motion sensors, any of which counts as motion in the zone
+    std::vector<int32_t> pins;
+    std::vector<Target> targets;
+    std::chrono::steady_clock::duration timeout;
+    /// How long before the off the lights dim as a warning, 0 for no warning
+    std::chrono::steady_clock::duration warn{0};
+    Scene scene;
+    std::shared_ptr<Schedule> schedule;
+};
+
+/// A zone and its state while the program runs
+struct Zone
+{
+    ZoneConfig config;
+    /// Bit n is set if pin n belongs to the zone
+    uint64_t pinMask = 0;
+    /// Cleared after the lights were turned on for the last time outside the schedule
+    std::atomic<bool> sensor{true};
+    /// Set while the lights are at the warning brightness
+    std::atomic<bool> dimmed{false};
+    /// Whether the last packet turned the lights on
+    std::atomic<bool> lit{false};
+    /// The zone's countdown in the rules' TimerQueue: the warning, then the off
+    TimerQueue::Id countdown;
+    /// Plays the scene's effect, if it has one
+    std::unique_ptr<Animation> animation;
+};
+
+/// Maps motion on the sensor pins to lights, one zone per group of lights.
+/// The zones are compiled into a flat array with a table from pin number to zone, so an
+/// edge is dispatched in constant time however many zones there are. All countdowns run
+/// on one TimerQueue thread, so every public method and every countdown stage holds the
+/// rules' lock while it looks at or changes a zone.
+class Rules
+{
+public:
+    /// Pin numbers must be below this
+    static constexpr int32_t maxPins = 64;
+    /// Frames per second of effects on strips, well below the 20 packets a second a bulb takes
+    static constexpr int effectRate = 10;
+
+    /// Parse zone lines like "hall pins=17,27 bulbs=192.168.1.92,lamp.local:56700 timeout=20 brightness=80".
+    /// Durations are in the unit given below unless they end in ms, s or m. The keys:
+    ///   pins=       The motion sensors, required
+    ///   bulbs=      The lights, host[:port]. broadcast or a subnet's broadcast address reaches them all in one datagram
+    ///   strips=     The multizone strips, host[:port], switched like the bulbs. bulbs= or strips= is required
+    ///   timeout=    Minutes the lights stay on after the motion stops
+    ///   brightness= Percent to turn on with
+    ///   kelvin=     Color temperature to turn on with, 1500-9000
+    ///   curve=      Brightness percent and kelvin by time of day instead, e.g. 07:00/100/5000,23:00/30/2700 (see DayCurve)
+    ///   warn=       Seconds before the off that the lights dim as a warning
+    ///   dim=        Percent the warning dims to
+    ///   fade=       Seconds the lights fade in over
+    ///   fadeoff=    Seconds the lights fade out over
+    ///   wave=       <saw|sine|half_sine|triangle|pulse>[:cycles[:skew]], dims kept-powered lights instead of switching them (see Scene)
+    ///   effect=     rainbow[:seconds per turn], played on the zone's strips while on, so it needs strips=
+    ///   schedule=   A file in the schedule.val format
+    /// Anything left out is taken from the defaults. Empty lines and lines starting with # are skipped.
+    /// @param in The stream to read from
+    /// @param defaults The values for settings a zone leaves out
+    static std::vector<ZoneConfig> parse(std::istream &in, const ZoneConfig &defaults)
+    {
+        std::vector<ZoneConfig> configs;
+        std::string line;
+        while (getline(in, line))
+        {
+            std::istringstream fields(line);
+            std::string name, field;
+            if (!(fields >> name) || name[0] == '#')
+                continue;
+
+            ZoneConfig config = defaults;
+            config.name = name;
+            config.pins.clear();
+            config.targets.clear();
+            try
+            {
+                while (fields >> field)
+                {
+                    auto equals = field.find('=');
+                    if (equals == std::string::npos)
+                        throw std::invalid_argument(field);
+                    std::string key = field.substr(0, equals);
+                    std::string value = field.substr(equals + 1);
+                    std::istringstream items(value);
+                    std::string item;
+
+                    if (key == "pins")
+                        while (getline(items, item, ','))
+                            config.pins.push_back(std::stoi(item));
+                    else if (key == "bulbs")
+                        while (getline(items, item, ','))
+                            config.targets.push_back(parseTarget(item));
+                    else if (key == "strips")
+                        while (getline(items, item, ','))
+                        {
+                            config.targets.push_back(parseTarget(item));
+                            config.targets.back().multizone = true;
+                        }
+                    else if (key == "timeout")
+                        config.timeout = std::chrono::duration_cast<std::chrono::steady_clock::duration>(parseDuration(value, 60));
+                    else if (key == "brightness")
+                        config.scene.brightness = (uint16_t)std::lround(std::min(std::max(std::stod(value), 0.0), 100.0) / 100 * UINT16_MAX);
+                    else if (key == "kelvin")
+                        config.scene.kelvin = (uint16_t)std::min(std::max(std::stoi(value), 1500), 9000);
+                    else if (key == "warn")
+                        config.warn = std::chrono::duration_cast<std::chrono::steady_clock::duration>(parseDuration(value, 1));
+                    else if (key == "dim")
+                        config.scene.dim = (uint16_t)std::lround(std::min(std::max(std::stod(value), 0.0), 100.0) / 100 * UINT16_MAX);
+                    else if (key == "curve")
+                        config.scene.curve = std::make_shared<DayCurve>(DayCurve::parse(value));
+                    else if (key == "effect")
+                    {
+                        auto colon = value.find(':');
+                        if (value.substr(0, colon) != "rainbow")
+                            throw std::invalid_argument(value);
+                        config.scene.rainbow = (colon == std::string::npos) ? 10 : parseDuration(value.substr(colon + 1), 1).count();
+                    }
+                    else if (key == "fade")
+                        config.scene.fadeOn = (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(parseDuration(value, 1)).count();
+                    else if (key == "fadeoff")
+                        config.scene.fadeOff = (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(parseDuration(value, 1)).count();
+                    else if (key == "wave")
+                        parseWave(value, config.scene);
+                    else if (key == "schedule")
+                    {
+                        config.schedule = std::make_shared<Schedule>();
+                        if (!Schedule::load(value, *config.schedule))
+                            throw std::runtime_error("Unable to open schedule " + value + " in zone line: " + line);
+                    }
+                    else
+                        throw std::invalid_argument(key);
+                }
+            }
+            catch (const std::logic_error &)
+            {
+                throw std::runtime_error("Invalid zone line: " + line);
+            }
+            if (config.pins.empty() || config.targets.empty())
+                throw std::runtime_error("Zone line without pins or bulbs: " + line);
+            if (config.scene.rainbow > 0 && std::none_of(config.targets.begin(), config.targets.end(), [](const Target &target) { return target.multizone; }))
+                throw std::runtime_error("Zone line with an effect but no strips: " + line);
+            configs.push_back(config);
+        }
+        return configs;
+    }
+
+    /// Read a zone file
+    /// @param filename The file to read
+    /// @param defaults The values for settings a zone leaves out
+    /// @param configs Where to store the zones
+    /// @return false if there was no such file
+    static bool load(const std::string &filename, const ZoneConfig &defaults, std::vector<ZoneConfig> &configs)
+    {
+        std::ifstream fs(filename);
+        if (!fs.is_open())
+            return false;
+        configs = parse(fs, defaults);
+        return true;
+    }
+
+    /// Set up the zones, replacing any there were
+    /// @param configs The zones
+    void compile(const std::vector<ZoneConfig> &configs)
+    {
+        // Check everything first, so bad zones leave the current ones running
+        std::array<int16_t, maxPins> owner;
+        owner.fill(-1);
+        for (size_t i = 0; i < configs.size(); i++)
+            for (auto pin : configs[i].pins)
+            {
+                if (pin < 0 || pin >= maxPins)
+                    throw std::runtime_error("Pin " + std::to_string(pin) + " of zone " + configs[i].name + " is out of range");
+                if (owner[pin] != -1)
+                    throw std::runtime_error("Pin " + std::to_string(pin) + " is used by both zone " + configs[owner[pin]].name + " and zone " + configs[i].name);
+                owner[pin] = (int16_t)i;
+            }
+
+        // The old queue goes first, its stages point into the old zones. It is joined without
+        // the lock, as a stage may be waiting for it, and finds no queue once it has it.
+        std::unique_lock<std::mutex> guard(mx);
+        std::unique_ptr<TimerQueue> old = std::move(timers);
+        guard.unlock();
+        old.reset();
+        guard.lock();
+
+        timers.reset(new TimerQueue);
+        timers->instrument(stats);
+        std::unique_ptr<Zone[]> previous = std::move(zones);
+        size_t previousCount = count;
+        count = configs.size();
+        zones.reset(new Zone[count]);
+        zoneOfPin = owner;
+        for (size_t i = 0; i < count; i++)
+        {
+            Zone &zone = zones[i];
+            zone.config = configs[i];
+            // The lights of a zone that is kept are still as they were
+            for (size_t j = 0; j < previousCount; j++)
+                if (previous[j].config.name == zone.config.name)
+                {
+                    zone.sensor = previous[j].sensor.load();
+                    zone.dimmed = previous[j].dimmed.load();
+                    zone.lit = previous[j].lit.load();
+                }
+            for (auto pin : zone.config.pins)
+                zone.pinMask |= 1ull << pin;
+            zone.countdown = timers->add(stagesOf(zone));
+            // In the background, a slow DNS server must not hold up the lock
+            for (auto &target : zone.config.targets)
+                Resolver::shared().prefetch(target.host);
+
+            const Scene &scene = zone.config.scene;
+            if (scene.rainbow > 0)
+            {
+                // SetExtendedColorZones means nothing to a single bulb
+                std::vector<Target> strips;
+                for (auto &target : zone.config.targets)
+                    if (target.multizone)
+                        strips.push_back(target);
+                size_t frames = std::max(1l, std::lround(scene.rainbow * effectRate));
+                zone.animation.reset(new Animation(strips, Animation::rainbow(lifxMaxZones, frames, onColor(scene).brightness),
+                                                   lifxMaxZones, std::chrono::milliseconds(1000 / effectRate)));
+            }
+        }
+        // The old effects stop before the new ones play on lights that stay on
+        previous.reset();
+        for (size_t i = 0; i < count; i++)
+            if (zones[i].lit && zones[i].animation)
+                zones[i].animation->start();
+    }
+
+    /// Record the fire time of every zone's countdown and log it when they fire
+    /// @param timerStats Where to record them
+    void instrument(TimerStats *timerStats)
+    {
+        std::lock_guard<std::mutex> guard(mx);
+        stats = timerStats;
+        timers->instrument(timerStats);
+    }
+
+    /// @return Every pin any zone listens to
+    std::vector<int32_t> pins()
+    {
+        std::vector<int32_t> result;
+        for (int32_t pin = 0; pin < maxPins; pin++)
+            if (zoneOfPin[pin] != -1)
+                result.push_back(pin);
+        return result;
+    }
+
+    size_t size() { return count; }
+    Zone &operator[](size_t i) { return zones[i]; }
+
+    /// @return The zone with a name, or nullptr if there is none
+    Zone *find(const std::string &name)
+    {
+        for (size_t i = 0; i < count; i++)
+            if (zones[i].config.name == name)
+                return &zones[i];
+        return nullptr;
+    }
+
+    /// Switch a zone's lights by hand. On starts the countdown like motion that has gone
+    /// again would, unless a sensor still sees motion; off cancels it.
+    /// @param zone The zone
+    /// @param on Whether to turn the lights on or off
+    void force(Zone &zone, bool on)
+    {
+        std::lock_guard<std::mutex> guard(mx);
+        log(zone.config.name + ": Turning " + (on ? "on" : "off") + " by command");
+        timers->stop(zone.countdown);
+        send(zone, on);
+        if (on && !(levels & zone.pinMask))
+            timers->start(zone.countdown);
+    }
+
+    /// Change how long a zone's lights stay on after the motion stops
+    /// @param zone The zone
+    /// @param timeout The new countdown length, a running countdown starts over with it
+    void setTimeout(Zone &zone, std::chrono::steady_clock::duration timeout)
+    {
+        std::lock_guard<std::mutex> guard(mx);
+        bool running = timers->isRunning(zone.countdown);
+        zone.config.timeout = timeout;
+        timers->setStages(zone.countdown, stagesOf(zone));
+        if (running)
+            timers->start(zone.countdown);
+    }
+
+    /// Start the countdown of every lit zone none of whose sensors sees motion, so lights left
+    /// on when compile() replaced the zones still go off
+    void startCountdowns()
+    {
+        std::lock_guard<std::mutex> guard(mx);
+        for (size_t i = 0; i < count; i++)
+            if (zones[i].lit && !(levels & zones[i].pinMask))
+                timers->start(zones[i].countdown);
+    }
+
+    /// @return One line per zone with its state, e.g.
+    ///         "hall lights=on countdown=running dimmed=no motion=no schedule=active timeout=1200s"
+    std::string status()
+    {
+        std::lock_guard<std::mutex> guard(mx);
+        std::ostringstream out;
+        for (size_t i = 0; i < count; i++)
+        {
+            Zone &zone = zones[i];
+            out << zone.config.name << " lights=" << (zone.lit ? "on" : "off")
+                << " countdown=" << (timers->isRunning(zone.countdown) ? "running" : "stopped")
+                << " dimmed=" << (zone.dimmed ? "yes" : "no")
+                << " motion=" << ((levels & zone.pinMask) ? "yes" : "no")
+                << " schedule=" << (zone.config.schedule->active() ? "active" : "inactive")
+                << " timeout=" << std::chrono::duration<double>(zone.config.timeout).count() << "s\n";
+        }
+        return out.str();
+    }
+
+    /// Act on an edge from one of the sensors
+    /// @param pin The pin the edge came from
+    /// @param edge The kind of edge
+    void onEdge(int32_t pin, GPIOEdge edge)
+    {
+        TRACE_SCOPE("rules");
+        std::lock_guard<std::mutex> guard(mx);
+        if (pin < 0 || pin >= maxPins || zoneOfPin[pin] == -1 || edge == GPIO_EDGE_NONE)
+            return;
+        Zone &zone = zones[zoneOfPin[pin]];
+        uint64_t bit = 1ull << pin;
+
+        if (edge == GPIO_EDGE_RISING)
+        {
+            levels.fetch_or(bit);
+            motion(zone);
+        }
+        else if (!((levels.fetch_and(~bit) & ~bit) & zone.pinMask))
+            still(zone);
+    }
+
+    /// A duration like "1.5", "90s", "500ms" or "20m"
+    /// @param value The text to parse
+    /// @param unit Seconds per unit when there is no suffix
+    static std::chrono::duration<double> parseDuration(const std::string &value, double unit)
+    {
+        size_t end;
+        double number = std::stod(value, &end);
+        std::string suffix = value.substr(end);
+        if (suffix == "ms")
+            unit = 0.001;
+        else if (suffix == "s")
+            unit = 1;
+        else if (suffix == "m")
+            unit = 60;
+        else if (!suffix.empty() || number < 0)
+            throw std::invalid_argument(value);
+        return std::chrono::duration<double>(number * unit);
+    }
+
+private:
+    /// Held by the public methods and the countdown stages, which run on different threads.
+    /// First, so it outlives the TimerQueue whose stages take it.
+    std::mutex mx;
+    std::unique_ptr<Zone[]> zones;
+    size_t count = 0;
+    std::array<int16_t, maxPins> zoneOfPin;
+    /// The last level seen on every pin, bit n for pin n
+    std::atomic<uint64_t> levels{0};
+    TimerStats *stats = nullptr;
+    /// After zones, so it is destroyed first
+    std::unique_ptr<TimerQueue> timers;
+
+    /// The countdown of a zone: the optional warning, then the off
+    std::vector<TimerQueue::Stage> stagesOf(Zone &zone)
+    {
+        std::vector<TimerQueue::Stage> stages{{zone.config.timeout, [this, &zone] { expired(zone); }}};
+        if (zone.config.warn > std::chrono::steady_clock::duration::zero() && zone.config.warn < zone.config.timeout)
+            stages.push_back({zone.config.timeout - zone.config.warn, [this, &zone] { warn(zone); }});
+        return stages;
+    }
+
+    /// "<shape>[:cycles[:skew]]"
+    static void parseWave(const std::string &value, Scene &scene)
+    {
+        static const char *names[] = {"saw", "sine", "half_sine", "triangle", "pulse"};
+        std::istringstream parts(value);
+        std::string part;
+        getline(parts, part, ':');
+        scene.wave = false;
+        for (int w = 0; w < 5; w++)
+            if (part == names[w])
+            {
+                scene.waveform = (LifxWaveform)w;
+                scene.wave = true;
+            }
+        if (!scene.wave)
+            throw std::invalid_argument(value);
+        if (getline(parts, part, ':'))
+            scene.cycles = std::stof(part);
+        if (getline(parts, part, ':'))
+            scene.skew = (int16_t)std::stoi(part);
+    }
+
+    /// The brightness and kelvin to turn on with right now
+    static LifxColor onColor(const Scene &scene)
+    {
+        return scene.curve ? scene.curve->at() : LifxColor{0, 0, scene.brightness, scene.kelvin};
+    }
+
+    /// Switch every light in the zone on or off, as the zone's scene says, which ends a warning
+    void send(Zone &zone, bool on)
+    {
+        const Scene &scene = zone.config.scene;
+        uint32_t fade = on ? scene.fadeOn : scene.fadeOff;
+        TRACE_SCOPE(on ? "send on" : "send off");
+        zone.lit = on;
+        // Either way the warning brightness is gone: on is at full, off has nothing to undim
+        zone.dimmed = false;
+        LifxColor color = on ? onColor(scene) : LifxColor{0, 0, 0, 0};
+        if (zone.animation)
+        {
+            if (on)
+                zone.animation->start();
+            else
+                zone.animation->stop();
+        }
+        if (scene.wave)
+        {
+            uint8_t packet[lifxSetWaveformOptionalSize];
+            lifxSetWaveformOptional(packet, false, color, fade, scene.cycles, scene.skew, scene.waveform,
+                                    false, false, true, on && scene.curve);
+            sendAll(packet, zone.config.targets);
+            return;
+        }
+        // SetPower only switches, the brightness is part of the color. The lights are off,
+        // so the color is set at once and the power fades it in.
+        if (on)
+        {
+            uint8_t packet[lifxSetColorSize];
+            lifxSetColor(packet, color, 0);
+            sendAll(packet, zone.config.targets);
+        }
+        uint8_t packet[lifxSetPowerSize];
+        {
+            TRACE_SCOPE("build packet");
+            lifxSetPower(packet, on ? UINT16_MAX : 0, fade);
+        }
+        sendAll(packet, zone.config.targets);
+    }
+
+    /// Change the brightness of every light in the zone, leaving their power as it is
+    void sendBrightness(Zone &zone, uint16_t brightness, uint32_t fade)
+    {
+        const Scene &scene = zone.config.scene;
+        uint8_t packet[lifxSetWaveformOptionalSize];
+        lifxSetWaveformOptional(packet, false, {0, 0, brightness, 0}, fade, 1, 0, scene.wave ? scene.waveform : LIFX_WAVEFORM_SAW,
+                                false, false, true, false);
+        sendAll(packet, zone.config.targets);
+    }
+
+    /// Whether the countdown running out should turn the lights off
+    bool turnsOff(Zone &zone)
+    {
+        return !(levels & zone.pinMask) && (zone.config.schedule->active() || zone.sensor);
+    }
+
+    /// Motion was detected by one of the zone's sensors
+    void motion(Zone &zone)
+    {
+        if (zone.dimmed.exchange(false))
+        {
+            // Back to full, right away if the lights are about to be powered on again
+            log(zone.config.name + ": Motion again, undimming");
+            sendBrightness(zone, onColor(zone.config.scene).brightness, zone.lit ? zone.config.scene.fadeOn : 0);
+        }
+        if (!zone.lit)
+        {
+            if (zone.config.schedule->active())
+            {
+                zone.sensor = true;
+                log(zone.config.name + ": Turning on");
+                pwrLed(true);
+                send(zone, true);
+            }
+            else if (zone.sensor)
+            {
+                zone.sensor = false;
+                log(zone.config.name + ": Turning on for last time");
+                pwrLed(false);
+                send(zone, true);
+            }
+        }
+        timers->stop(zone.countdown);
+    }
+
+    /// All of the zone's sensors have gone quiet
+    void still(Zone &zone)
+    {
+        timers->start(zone.countdown);
+    }
+
+    /// Whether a countdown stage that has the lock now should still act: not if the rules were
+    /// recompiled or the countdown was stopped or restarted while it waited for the lock
+    bool stale(Zone &zone)
+    {
+        return !timers || timers->superseded(zone.countdown);
+    }
+
+    /// The warning stage of the countdown, called from the TimerQueue's thread
+    void warn(Zone &zone)
+    {
+        std::lock_guard<std::mutex> guard(mx);
+        if (!stale(zone) && turnsOff(zone))
+        {
+            log(zone.config.name + ": Dimming before turning off");
+            zone.dimmed = true;
+            sendBrightness(zone, zone.config.scene.dim, zone.config.scene.fadeOff);
+        }
+    }
+
+    /// The countdown ran out, called from the TimerQueue's thread
+    void expired(Zone &zone)
+    {
+        std::lock_guard<std::mutex> guard(mx);
+        if (stale(zone))
+            return;
+        if (stats)
+            log(zone.config.name + ": Countdown jitter: " + stats->summary().describe());
+        if (turnsOff(zone))
+        {
+            log(zone.config.name + ": Turning off");
+            send(zone, false);
+        }
+    }
+};
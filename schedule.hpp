@@ -0,0 +1,338 @@
+#pragma once
+
+#include "solar.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <time.h>
+#include <vector>
+
+/// A weekly set of windows in which the lights are managed.
+/// The windows are compiled into a table with one bit per minute of the week, and the
+/// time of the next change is cached, so active() is a clock read and a comparison
+/// until a window actually opens or closes. Windows may start or stop relative to sunrise
+/// and sunset, in which case the table is recompiled once a day.
+class Schedule
+{
+public:
+    static constexpr int minutesPerDay = 24 * 60;
+    static constexpr int minutesPerWeek = 7 * minutesPerDay;
+
+    /// One end of a window
+    struct Edge
+    {
+        enum Base : uint8_t
+        {
+            CLOCK,
+            SUNRISE,
+            SUNSET
+        } base;
+        /// Minutes after midnight for CLOCK, otherwise minutes after (or before, if negative) the sun event
+        int minutes;
+    };
+
+    /// One active window, on the days set in the mask (bit 0 = Sunday, like tm_wday).
+    /// A stop at or before the start means the window ends the next day. For windows
+    /// relative to the sun that is decided with an equinox sun (06:00-18:00), so that
+    /// "sunset-23:00" is empty rather than 23 hours long on days the sun sets after 23:00.
+    struct Window
+    {
+        uint8_t days;
+        Edge start;
+        Edge stop;
+    };
+
+    /// The same window every day, like start.val/stop.val have always meant. Hours that are
+    /// the same once clamped to 0-24, like the -1 config() gives for both files missing,
+    /// make a schedule that is never active rather than a window all day.
+    /// @param startHour Fractional hour the window opens
+    /// @param stopHour Fractional hour the window closes
+    static Schedule daily(double startHour, double stopHour)
+    {
+        auto clamp = [](double h) { return (int)std::lround(std::min(std::max(h, 0.0), 24.0) * 60); };
+        int start = clamp(startHour), stop = clamp(stopHour);
+        if (stop == start)
+            return Schedule();
+        return Schedule({{0x7f, {Edge::CLOCK, start}, {Edge::CLOCK, stop}}});
+    }
+
+    /// Parse lines like "mon-fri 07:00-23:30", "sat,sun 9-1", "* 22:00-06:00" or
+    /// "* sunset-30m-sunrise+15m". Windows using sunrise or sunset need a line
+    /// "location <latitude> <longitude>" in decimal degrees, north and east positive.
+    /// Empty lines and lines starting with # are skipped.
+    /// @param in The stream to read from
+    static Schedule parse(std::istream &in)
+    {
+        std::vector<Window> windows;
+        double latitude = NAN, longitude = NAN;
+        std::string line;
+        while (getline(in, line))
+        {
+            std::istringstream fields(line);
+            std::string days, times;
+            if (!(fields >> days) || days[0] == '#')
+                continue;
+            if (days == "location")
+            {
+                if (!(fields >> latitude >> longitude) || std::abs(latitude) > 90 || std::abs(longitude) > 180)
+                    throw std::runtime_error("Invalid schedule line: " + line);
+                continue;
+            }
+            if (!(fields >> times))
+                throw std::runtime_error("Invalid schedule line: " + line);
+            size_t pos = 0;
+            Window window{parseDays(days, line), parseEdge(times, pos, line), {}};
+            if (pos >= times.size() || times[pos++] != '-')
+                throw std::runtime_error("Invalid schedule line: " + line);
+            window.stop = parseEdge(times, pos, line);
+            if (pos != times.size())
+                throw std::runtime_error("Invalid schedule line: " + line);
+            windows.push_back(window);
+        }
+        return Schedule(windows, latitude, longitude);
+    }
+
+    /// Read a schedule file
+    /// @param filename The file to read
+    /// @param schedule Where to store it
+    /// @return false if there was no such file
+    static bool load(const std::string &filename, Schedule &schedule)
+    {
+        std::ifstream fs(filename);
+        if (!fs.is_open())
+            return false;
+        schedule = parse(fs);
+        return true;
+    }
+
+    /// @param windowList The windows in which the lights are managed
+    /// @param lat Latitude for windows relative to the sun, in degrees
+    /// @param lon Longitude for windows relative to the sun, in degrees
+    explicit Schedule(std::vector<Window> windowList = {}, double lat = NAN, double lon = NAN)
+        : windows(std::move(windowList)), latitude(lat), longitude(lon)
+    {
+        sun = std::any_of(windows.begin(), windows.end(), [](const Window &w) {
+            return w.start.base != Edge::CLOCK || w.stop.base != Edge::CLOCK;
+        });
+        if (sun && (std::isnan(latitude) || std::isnan(longitude)))
+            throw std::runtime_error("The schedule uses sunrise or sunset but has no location");
+        compile(time(nullptr));
+    }
+
+    Schedule(const Schedule &other) : Schedule(other.windows, other.latitude, other.longitude) {}
+
+    Schedule &operator=(const Schedule &other)
+    {
+        std::lock_guard<std::mutex> guard(mx);
+        windows = other.windows;
+        latitude = other.latitude;
+        longitude = other.longitude;
+        sun = other.sun;
+        compile(time(nullptr));
+        cached = 0;
+        validFrom = 0;
+        return *this;
+    }
+
+    /// Whether the lights are managed at a given time. Safe to call from several threads.
+    /// @param now The time to check, normally the current time
+    bool active(time_t now = time(nullptr))
+    {
+        auto c = cached.load(std::memory_order_acquire);
+        if (now < (time_t)(c >> 1) && now >= validFrom.load(std::memory_order_relaxed))
+            return c & 1;
+        return recompute(now);
+    }
+
+    /// @return The cached time active() next changes, for logging
+    time_t nextChange() { return (time_t)(cached.load() >> 1); }
+
+private:
+    std::vector<Window> windows;
+    double latitude;
+    double longitude;
+    /// Whether any window depends on the sun, and so has to be recompiled every day
+    bool sun = false;
+    /// The local day (year * 1000 + day of year) the table was compiled on
+    int compiledDay = -1;
+    std::bitset<minutesPerWeek> table;
+    std::mutex mx;
+    /// (time of next change << 1) | active
+    std::atomic<int64_t> cached{0};
+    /// When the cache was computed, to notice the clock going backwards
+    std::atomic<time_t> validFrom{0};
+
+    static int dayKey(const tm &local) { return local.tm_year * 1000 + local.tm_yday; }
+
+    /// Build the table for the week starting today, with each weekday's own sunrise and sunset
+    void compile(time_t now)
+    {
+        tm today;
+        localtime_r(&now, &today);
+        compiledDay = dayKey(today);
+
+        SolarDay days[7] = {};
+        for (int day = 0; sun && day < 7; day++)
+        {
+            tm date = today;
+            date.tm_mday += (day - today.tm_wday + 7) % 7;
+            date.tm_hour = 12;
+            date.tm_isdst = -1;
+            mktime(&date);
+            days[day] = solarDay(date.tm_year + 1900, date.tm_mon + 1, date.tm_mday, latitude, longitude);
+        }
+        auto resolve = [](const Edge &edge, const SolarDay &solar) {
+            int minutes = edge.minutes;
+            if (edge.base == Edge::SUNRISE)
+                minutes += solar.sunrise;
+            else if (edge.base == Edge::SUNSET)
+                minutes += solar.sunset;
+            return std::min(std::max(minutes, 0), minutesPerDay);
+        };
+
+        const SolarDay equinox{6 * 60, 18 * 60};
+
+        table.reset();
+        for (auto &w : windows)
+        {
+            bool overnight = resolve(w.stop, equinox) <= resolve(w.start, equinox);
+            for (int day = 0; day < 7; day++)
+                if (w.days & (1 << day))
+                {
+                    int start = resolve(w.start, days[day]);
+                    int stop = resolve(w.stop, days[day]);
+                    int length = (stop > start) ? stop - start : (overnight ? stop + minutesPerDay - start : 0);
+                    for (int m = 0; m < length; m++)
+                        table.set((day * minutesPerDay + start + m) % minutesPerWeek);
+                }
+        }
+    }
+
+    /// The slow path: look the current minute up in the table and find the next change
+    bool recompute(time_t now)
+    {
+        std::lock_guard<std::mutex> guard(mx);
+        tm local;
+        localtime_r(&now, &local);
+        if (sun && dayKey(local) != compiledDay)
+            compile(now);
+        int minute = local.tm_wday * minutesPerDay + local.tm_hour * 60 + local.tm_min;
+        bool state = table[minute];
+
+        int ahead = 1;
+        while (ahead < minutesPerWeek && table[(minute + ahead) % minutesPerWeek] == state)
+            ahead++;
+
+        time_t next;
+        if (ahead == minutesPerWeek)
+            next = now + 24 * 60 * 60; // Never changes, but check again tomorrow
+        else
+        {
+            // Let mktime() walk the wall clock forward, so DST changes land on the right instant
+            tm change = local;
+            change.tm_sec = 0;
+            change.tm_min += ahead;
+            change.tm_isdst = -1;
+            next = mktime(&change);
+            if (next <= now) // Wall time repeated by a DST change, try again in a minute
+                next = now + 60;
+        }
+        if (sun)
+        {
+            // Come back at midnight at the latest, to pick up the new day's sunrise and sunset
+            tm midnight = local;
+            midnight.tm_mday += 1;
+            midnight.tm_hour = midnight.tm_min = midnight.tm_sec = 0;
+            midnight.tm_isdst = -1;
+            next = std::min(next, mktime(&midnight));
+        }
+
+        validFrom.store(now, std::memory_order_relaxed);
+        cached.store(((int64_t)next << 1) | state, std::memory_order_release);
+        return state;
+    }
+
+    static uint8_t parseDays(const std::string &spec, const std::string &line)
+    {
+        static const char *names[] = {"sun", "mon", "tue", "wed", "thu", "fri", "sat"};
+        auto day = [&](const std::string &name) {
+            for (int d = 0; d < 7; d++)
+                if (name == names[d])
+                    return d;
+            throw std::runtime_error("Invalid day \"" + name + "\" in schedule line: " + line);
+        };
+
+        if (spec == "*")
+            return 0x7f;
+        uint8_t mask = 0;
+        std::istringstream parts(spec);
+        std::string part;
+        while (getline(parts, part, ','))
+        {
+            auto dash = part.find('-');
+            int first = day(part.substr(0, dash));
+            int last = (dash == std::string::npos) ? first : day(part.substr(dash + 1));
+            for (int d = first;; d = (d + 1) % 7)
+            {
+                mask |= 1 << d;
+                if (d == last)
+                    break;
+            }
+        }
+        return mask;
+    }
+
+    /// "sunrise" or "sunset" with an optional offset like "+15m" or "-30m", or a clock time
+    static Edge parseEdge(const std::string &times, size_t &pos, const std::string &line)
+    {
+        for (auto base : {Edge::SUNRISE, Edge::SUNSET})
+        {
+            std::string name = (base == Edge::SUNRISE) ? "sunrise" : "sunset";
+            if (times.compare(pos, name.size(), name) != 0)
+                continue;
+            pos += name.size();
+            Edge edge{base, 0};
+            // A sign is only an offset if minutes and an 'm' follow, otherwise it separates the two ends
+            size_t end = pos + 1;
+            while (end < times.size() && isdigit((unsigned char)times[end]))
+                end++;
+            if (pos < times.size() && (times[pos] == '+' || times[pos] == '-') && end > pos + 1 && end < times.size() && times[end] == 'm')
+            {
+                edge.minutes = std::stoi(times.substr(pos + 1, end - pos - 1)) * (times[pos] == '-' ? -1 : 1);
+                pos = end + 1;
+            }
+            return edge;
+        }
+        size_t end = pos;
+        while (end < times.size() && (isdigit((unsigned char)times[end]) || times[end] == ':' || times[end] == '.'))
+            end++;
+        Edge edge{Edge::CLOCK, parseClock(times.substr(pos, end - pos), line)};
+        pos = end;
+        return edge;
+    }
+
+    /// "HH:MM" or a (fractional) hour
+    static int parseClock(const std::string &spec, const std::string &line)
+    {
+        try
+        {
+            auto colon = spec.find(':');
+            int minutes = (colon == std::string::npos)
+                              ? (int)std::lround(std::stod(spec) * 60)
+                              : std::stoi(spec.substr(0, colon)) * 60 + std::stoi(spec.substr(colon + 1));
+            if (minutes >= 0 && minutes <= minutesPerDay)
+                return minutes % minutesPerDay;
+        }
+        catch (const std::logic_error &)
+        {
+        }
+        throw std::runtime_error("Invalid time \"" + spec + "\" in schedule line: " + line);
+    }
+};
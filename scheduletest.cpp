@@ -0,0 +1,67 @@
+/**
+ * PirTimer
+ * scheduletest.cpp
+ * Purpose: Checks that Schedule::daily keeps the meaning start.val/stop.val have always had
+ * Dependencies: schedule.hpp
+ *
+ * Prints every failed check and exits non-zero if there was one.
+ *
+ * Usage: ./scheduletest (or make test)
+*/
+
+#include "schedule.hpp"
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+int failures = 0;
+
+/// The local time of day on a fixed date, so the checks never cross a DST change
+/// @param hour The hour
+/// @param minute The minute
+time_t at(int hour, int minute)
+{
+  tm local{};
+  local.tm_year = 2024 - 1900;
+  local.tm_mon = 5;
+  local.tm_mday = 12;
+  local.tm_hour = hour;
+  local.tm_min = minute;
+  local.tm_isdst = -1;
+  return mktime(&local);
+}
+
+/// Check the schedule at a few times of day
+/// @param name What is checked
+/// @param schedule The schedule
+/// @param expected Whether it should be active at 00:00, 07:30, 12:00 and 23:30
+void check(const std::string &name, Schedule schedule, const bool (&expected)[4])
+{
+  const int times[4][2] = {{0, 0}, {7, 30}, {12, 0}, {23, 30}};
+  for (int i = 0; i < 4; i++)
+  {
+    if (schedule.active(at(times[i][0], times[i][1])) == expected[i])
+      continue;
+    std::cout << "FAILED: " << name << " at " << std::setfill('0') << std::setw(2) << times[i][0] << ":"
+              << std::setw(2) << times[i][1] << " should be "
+              << (expected[i] ? "active" : "inactive") << std::endl;
+    failures++;
+  }
+}
+
+int main()
+{
+  check("no start.val and stop.val", Schedule::daily(-1, -1), {false, false, false, false});
+  check("start after stop, both before midnight", Schedule::daily(-2, -1), {false, false, false, false});
+  check("start equal to stop", Schedule::daily(7, 7), {false, false, false, false});
+  check("whole day", Schedule::daily(-1, 25), {true, true, true, true});
+  check("day window", Schedule::daily(7, 17), {false, true, true, false});
+  check("night window", Schedule::daily(22, 6), {true, false, false, true});
+  check("no windows", Schedule(), {false, false, false, false});
+
+  if (failures)
+    return 1;
+  std::cout << "All schedule checks passed" << std::endl;
+  return 0;
+}
@@ -1,3 +1,5 @@
+#include "resolver.hpp"
+#include "trace.hpp"
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -12,42 +14,55 @@
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <errno.h>
 
-void error(const char *);
+int error(const char *);
 
+/// Send a packet over UDP
+/// @return Error code: 0 on success, -1 if the host is unknown or the socket or sendto failed (see errno)
 template <typename T, size_t N>
-int sendPacket(T (&buffer)[N], const char *ip)
+int sendPacket(T (&buffer)[N], const char *ip, uint16_t port = 56700)
 {
+  TRACE_SCOPE("sendto");
   int sock, n;
   unsigned int length;
   struct sockaddr_in server;
-  struct hostent *hp;
-  hp = gethostbyname(ip);
-  if (hp == 0)
-    error("Unknown host");
+  // Cached, so only the first packet to a name can wait for DNS
+  if (!Resolver::shared().lookup(ip, server.sin_addr))
+  {
+    errno = EHOSTUNREACH;
+    return error("Unknown host");
+  }
 
   sock = socket(AF_INET, SOCK_DGRAM, 0);
   if (sock < 0)
-    error("socket");
+    return error("socket");
+  // Lets ip be a broadcast address, for packets every bulb on the subnet acts on
+  int broadcast = 1;
+  setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
 
   server.sin_family = AF_INET;
-  bcopy((char *)hp->h_addr,
-        (char *)&server.sin_addr,
-        hp->h_length);
-  server.sin_port = htons(atoi("56700"));
+  server.sin_port = htons(port);
   length = sizeof(struct sockaddr_in);
 
   n = sendto(sock, buffer, sizeof(buffer), 0, (const struct sockaddr *)&server, length);
   if (n < 0)
-    error("Sendto");
+  {
+    int sendErrno = errno;
+    close(sock);
+    errno = sendErrno;
+    return error("Sendto");
+  }
   // printf("Sending Packet...\n");
 
   close(sock);
   return 0;
 }
 
-void error(const char *msg)
+/// Report a failed send, which the caller deals with
+/// @return -1
+int error(const char *msg)
 {
   perror(msg);
-  exit(1);
+  return -1;
 }
\ No newline at end of file
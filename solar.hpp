@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cmath>
+#include <time.h>
+
+/// Sunrise and sunset of one day, in minutes after local midnight
+struct SolarDay
+{
+    int sunrise;
+    int sunset;
+};
+
+/// Compute sunrise and sunset for a date and place, using the sunrise algorithm from the
+/// Almanac for Computers (accurate to a minute or two, which is plenty for lights).
+/// In polar night the sun "rises" at 24:00 and "sets" at 00:00, so a sunrise-sunset window
+/// is empty and a sunset-sunrise window covers the whole day. Under the midnight sun it is
+/// the other way round.
+/// @param year The year, e.g. 2020
+/// @param month The month, 1-12
+/// @param day The day of the month, 1-31
+/// @param latitude Degrees, north is positive
+/// @param longitude Degrees, east is positive
+/// @return The times in the local time zone
+inline SolarDay solarDay(int year, int month, int day, double latitude, double longitude)
+{
+    const double rad = M_PI / 180;
+    const double zenith = 90.833; // Official sunrise, with refraction and the sun's radius
+
+    tm date{};
+    date.tm_year = year - 1900;
+    date.tm_mon = month - 1;
+    date.tm_mday = day;
+    time_t midnightUtc = timegm(&date); // Also fills in tm_yday
+    double lngHour = longitude / 15;
+
+    auto event = [&](bool rising, double &utcHour) {
+        double t = date.tm_yday + 1 + ((rising ? 6 : 18) - lngHour) / 24;
+        double M = 0.9856 * t - 3.289;
+        double L = std::fmod(M + 1.916 * std::sin(M * rad) + 0.020 * std::sin(2 * M * rad) + 282.634 + 360, 360);
+        double RA = std::fmod(std::atan(0.91764 * std::tan(L * rad)) / rad + 360, 360);
+        RA = (RA + std::floor(L / 90) * 90 - std::floor(RA / 90) * 90) / 15;
+        double sinDec = 0.39782 * std::sin(L * rad);
+        double cosDec = std::cos(std::asin(sinDec));
+        double cosH = (std::cos(zenith * rad) - sinDec * std::sin(latitude * rad)) / (cosDec * std::cos(latitude * rad));
+        if (cosH > 1 || cosH < -1)
+            return cosH; // The sun never rises (> 1) or never sets (< -1) that day
+        double H = (rising ? 360 - std::acos(cosH) / rad : std::acos(cosH) / rad) / 15;
+        utcHour = std::fmod(H + RA - 0.06571 * t - 6.622 - lngHour + 48, 24);
+        return 0.0;
+    };
+    auto local = [&](double utcHour) {
+        time_t instant = midnightUtc + (time_t)std::lround(utcHour * 3600);
+        tm lt;
+        localtime_r(&instant, &lt);
+        return lt.tm_hour * 60 + lt.tm_min;
+    };
+
+    double riseHour = 0, setHour = 0;
+    double polar = event(true, riseHour);
+    if (polar == 0)
+        polar = event(false, setHour);
+    if (polar > 0)
+        return {24 * 60, 0};
+    if (polar < 0)
+        return {0, 24 * 60};
+    return {local(riseHour), local(setHour)};
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+/// A fixed size ring for handing items from exactly one producer thread to exactly one
+/// consumer thread. push() and pop() are wait-free: a couple of atomic loads and one
+/// store, no locks and no allocation, so the producer's timing never depends on the consumer.
+/// @tparam T The items, copied in and out
+/// @tparam Size The capacity, a power of two
+template <class T, size_t Size>
+class SpscQueue
+{
+    static_assert(Size && !(Size & (Size - 1)), "Size must be a power of two");
+
+public:
+    /// Called from the producer thread only
+    /// @return false if the queue is full, in which case the item is dropped
+    bool push(const T &item)
+    {
+        size_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail - headCache == Size)
+        {
+            headCache = headIndex.load(std::memory_order_acquire);
+            if (tail - headCache == Size)
+                return false;
+        }
+        items[tail & (Size - 1)] = item;
+        tailIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Called from the consumer thread only
+    /// @return false if the queue is empty
+    bool pop(T &item)
+    {
+        size_t head = headIndex.load(std::memory_order_relaxed);
+        if (head == tailCache)
+        {
+            tailCache = tailIndex.load(std::memory_order_acquire);
+            if (head == tailCache)
+                return false;
+        }
+        item = items[head & (Size - 1)];
+        headIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T items[Size];
+    // Each side's index on its own cache line, next to its cached copy of the other side's
+    alignas(64) std::atomic<size_t> tailIndex{0};
+    size_t headCache = 0;
+    alignas(64) std::atomic<size_t> headIndex{0};
+    size_t tailCache = 0;
+};
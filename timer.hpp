@@ -1,51 +1,172 @@
+#pragma once
+
+#include "metrics.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <iostream>
 #include <mutex>
+#include <queue>
+#include <string>
 #include <thread>
+#include <vector>
+
+/// Records how far from their deadline timers actually fire. The percentiles are over a
+/// fixed window of the latest fires, so a daemon running for months neither grows nor slows.
+class TimerStats
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// How many of the latest fires the percentiles are taken over
+    static constexpr size_t window = 1024;
+
+    /// Distribution of lateness (actual - scheduled fire time), negative when early. count,
+    /// min, max and mean cover every fire, p50 and p99 the last window of them.
+    struct Summary
+    {
+        size_t count = 0;
+        Clock::duration min{}, p50{}, p99{}, max{}, mean{};
+
+        /// @return A one line description, in microseconds
+        std::string describe() const
+        {
+            auto us = [](Clock::duration d) { return std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(d).count()); };
+            return std::to_string(count) + " fires, late by min " + us(min) + " p50 " + us(p50) +
+                   " p99 " + us(p99) + " max " + us(max) + " mean " + us(mean) + " us";
+        }
+    };
+
+    /// Record one countdown that ran out
+    /// @param scheduled When it was supposed to fire
+    /// @param actual When it did fire
+    void record(Clock::time_point scheduled, Clock::time_point actual)
+    {
+        std::lock_guard<std::mutex> guard(mx);
+        Clock::duration late = actual - scheduled;
+        if (recent.size() < window)
+            recent.push_back(late);
+        else
+            recent[count % window] = late;
+        lowest = count ? std::min(lowest, late) : late;
+        highest = count ? std::max(highest, late) : late;
+        sum += late;
+        count++;
+    }
+
+    /// @return The distribution of everything recorded so far
+    Summary summary()
+    {
+        std::lock_guard<std::mutex> guard(mx);
+        Summary result;
+        if (!count)
+            return result;
+        auto sorted = recent;
+        std::sort(sorted.begin(), sorted.end());
+        auto at = [&](double q) { return sorted[std::min(sorted.size() - 1, (size_t)(q * sorted.size()))]; };
+        result.count = count;
+        result.min = lowest;
+        result.p50 = at(0.50);
+        result.p99 = at(0.99);
+        result.max = highest;
+        result.mean = sum / (Clock::rep)count;
+        return result;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> guard(mx);
+        recent.clear();
+        count = 0;
+        sum = Clock::duration::zero();
+    }
+
+private:
+    std::mutex mx;
+    /// The last window fires, the oldest overwritten first
+    std::vector<Clock::duration> recent;
+    size_t count = 0;
+    Clock::duration lowest{}, highest{}, sum{};
+};
 
+/// Runs a function once a countdown of any chrono duration runs out, unless stopped first
 class Timer
 {
 private:
-    std::chrono::duration<int> timeout;
+    std::chrono::steady_clock::duration timeout;
+    std::chrono::steady_clock::time_point deadline;
 
-    bool running = false;
+    std::atomic<bool> running{false};
     std::mutex mx;
     std::condition_variable cond;
     std::thread t_time;
     std::function<void()> func;
+    TimerStats *stats = nullptr;
 
     void worker()
     {
         std::unique_lock<std::mutex> guard(mx);
-        cond.wait_for(guard, timeout);
+        // The predicate makes spurious wakeups go back to waiting for the same deadline
+        cond.wait_until(guard, deadline, [this] { return !running; });
         if (running)
+        {
+            auto now = std::chrono::steady_clock::now();
+            if (stats)
+                stats->record(deadline, now);
+            Metrics::shared().timerFires.inc();
+            Metrics::shared().timerLateness.observe(now - deadline);
             func();
+        }
         cond.notify_one();
         running = false;
     }
 
 public:
-    Timer(int minutes, std::function<void()> donefunc)
+    /// @param waittime The countdown length, e.g. std::chrono::seconds(90) or std::chrono::duration<double, std::ratio<60>>(1.5)
+    /// @param donefunc Called from the timer's thread when a countdown runs out
+    template <class Rep, class Period>
+    Timer(std::chrono::duration<Rep, Period> waittime, std::function<void()> donefunc)
     {
-        timeout = std::chrono::minutes(minutes);
+        timeout = std::chrono::duration_cast<std::chrono::steady_clock::duration>(waittime);
         func = std::move(donefunc);
     }
 
+    ~Timer() { stop(); }
+
     bool isRunning() { return running; }
 
-    void setTimeout(int minutes)
+    template <class Rep, class Period>
+    void setTimeout(std::chrono::duration<Rep, Period> waittime)
     {
-        timeout = std::chrono::minutes(minutes);
+        timeout = std::chrono::duration_cast<std::chrono::steady_clock::duration>(waittime);
     }
 
-    void start(uint32_t minutes = 0)
+    /// Record the scheduled and actual fire time of every countdown from now on
+    /// @param timerStats Where to record them, or nullptr to stop recording
+    void instrument(TimerStats *timerStats)
     {
-        if (minutes != 0)
-            timeout = std::chrono::minutes(minutes);
-        if (running)
-            stop();
+        std::lock_guard<std::mutex> guard(mx);
+        stats = timerStats;
+    }
+
+    /// (Re)start the countdown with a new length
+    template <class Rep, class Period>
+    void start(std::chrono::duration<Rep, Period> waittime)
+    {
+        setTimeout(waittime);
+        start();
+    }
+
+    /// (Re)start the countdown with the current length
+    void start()
+    {
+        stop();
+        Metrics::shared().timerStarts.inc();
+        deadline = std::chrono::steady_clock::now() + timeout;
         running = true;
         t_time = std::thread(&Timer::worker, this);
     }
@@ -54,9 +175,199 @@ public:
     {
         if (running)
         {
+            // Under the lock, so the worker cannot miss the notification
+            std::lock_guard<std::mutex> guard(mx);
             running = false;
-            cond.notify_one();
+        }
+        cond.notify_one();
+        // Also reaps a worker that already fired on its own
+        if (t_time.joinable())
             t_time.join();
+    }
+};
+
+/// Runs any number of countdowns on one thread. A countdown has one or more stages, each
+/// firing a function a fixed time after the countdown was started, so a zone can warn
+/// before it turns off without a thread per deadline like Timer has.
+/// Unlike Timer, start() and stop() never wait for a stage that is firing, so they can be
+/// called while holding a lock the stage takes too. Such a stage calls superseded() once
+/// it has the lock, to find out whether it was stopped or restarted in the meantime.
+class TimerQueue
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Id = size_t;
+
+    /// One deadline of a countdown
+    struct Stage
+    {
+        /// Time from start() to firing
+        Clock::duration after;
+        /// Called from the queue's thread
+        std::function<void()> func;
+    };
+
+    TimerQueue() : t_queue(&TimerQueue::worker, this) {}
+
+    ~TimerQueue()
+    {
+        {
+            std::lock_guard<std::mutex> guard(mx);
+            quit = true;
+        }
+        cond.notify_one();
+        t_queue.join();
+    }
+
+    /// Add a countdown, stopped
+    /// @param stages The deadlines, in the order they fire
+    /// @return What to pass to start() and stop()
+    Id add(std::vector<Stage> stages)
+    {
+        std::lock_guard<std::mutex> guard(mx);
+        std::sort(stages.begin(), stages.end(), [](const Stage &a, const Stage &b) { return a.after < b.after; });
+        countdowns.push_back({std::move(stages), 0, false});
+        return countdowns.size() - 1;
+    }
+
+    /// Record the scheduled and actual fire time of every stage from now on
+    /// @param timerStats Where to record them, or nullptr to stop recording
+    void instrument(TimerStats *timerStats)
+    {
+        std::lock_guard<std::mutex> guard(mx);
+        stats = timerStats;
+    }
+
+    /// Replace the stages of a countdown, which stops it
+    /// @param stages The new deadlines
+    void setStages(Id id, std::vector<Stage> stages)
+    {
+        std::lock_guard<std::mutex> guard(mx);
+        std::sort(stages.begin(), stages.end(), [](const Stage &a, const Stage &b) { return a.after < b.after; });
+        countdowns[id].stages = std::move(stages);
+        countdowns[id].generation++;
+        countdowns[id].running = false;
+    }
+
+    /// (Re)start a countdown from its first stage
+    void start(Id id)
+    {
+        std::unique_lock<std::mutex> guard(mx);
+        Countdown &countdown = countdowns[id];
+        countdown.generation++;
+        countdown.running = !countdown.stages.empty();
+        Metrics::shared().timerStarts.inc();
+        TRACE_INSTANT("timer arm");
+        if (countdown.running)
+        {
+            Clock::time_point started = Clock::now();
+            heap.push({started + countdown.stages[0].after, started, id, countdown.generation, 0});
+        }
+        guard.unlock();
+        cond.notify_one();
+    }
+
+    /// Cancel the stages of a countdown that have not fired yet. A stage that is firing right
+    /// now carries on, see superseded().
+    void stop(Id id)
+    {
+        std::lock_guard<std::mutex> guard(mx);
+        countdowns[id].generation++;
+        countdowns[id].running = false;
+    }
+
+    /// @return Whether the countdown has stages left to fire
+    bool isRunning(Id id)
+    {
+        std::lock_guard<std::mutex> guard(mx);
+        return countdowns[id].running;
+    }
+
+    /// Called from a stage of the countdown only
+    /// @return Whether the countdown was stopped, restarted or given new stages since the stage fired
+    bool superseded(Id id)
+    {
+        std::lock_guard<std::mutex> guard(mx);
+        return countdowns[id].generation != firingGeneration;
+    }
+
+private:
+    struct Countdown
+    {
+        std::vector<Stage> stages;
+        /// Bumped by start() and stop(), so entries still in the heap know they are stale
+        uint32_t generation;
+        bool running;
+    };
+
+    struct Entry
+    {
+        Clock::time_point deadline;
+        Clock::time_point started;
+        Id id;
+        uint32_t generation;
+        size_t stage;
+
+        bool operator>(const Entry &other) const { return deadline > other.deadline; }
+    };
+
+    std::mutex mx;
+    std::condition_variable cond;
+    /// A deque, so add() never moves a countdown while the worker refers to it
+    std::deque<Countdown> countdowns;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+    /// The generation of the countdown whose stage is firing, for superseded()
+    uint32_t firingGeneration = 0;
+    TimerStats *stats = nullptr;
+    bool quit = false;
+    std::thread t_queue;
+
+    void worker()
+    {
+        std::unique_lock<std::mutex> guard(mx);
+        while (!quit)
+        {
+            if (heap.empty())
+            {
+                cond.wait(guard);
+                continue;
+            }
+            Entry next = heap.top();
+            if (next.generation != countdowns[next.id].generation)
+            {
+                heap.pop(); // Stopped or restarted since it was queued
+                continue;
+            }
+            if (Clock::now() < next.deadline)
+            {
+                // Woken by start() or stop() or the deadline, the top is looked at again either
+                // way: an earlier entry may have been pushed meanwhile
+                cond.wait_until(guard, next.deadline);
+                continue;
+            }
+            heap.pop();
+
+            Countdown &countdown = countdowns[next.id];
+            Clock::time_point now = Clock::now();
+            if (stats)
+                stats->record(next.deadline, now);
+            Metrics::shared().timerFires.inc();
+            Metrics::shared().timerLateness.observe(now - next.deadline);
+            if (next.stage + 1 < countdown.stages.size())
+                heap.push({next.started + countdown.stages[next.stage + 1].after, next.started, next.id, next.generation, next.stage + 1});
+            else
+                countdown.running = false;
+
+            // A copy, run without the lock, so the stage can start or stop countdowns and
+            // setStages() can replace it meanwhile
+            std::function<void()> func = countdown.stages[next.stage].func;
+            firingGeneration = next.generation;
+            guard.unlock();
+            {
+                TRACE_SCOPE("timer fire");
+                func();
+            }
+            guard.lock();
         }
     }
 };
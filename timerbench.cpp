@@ -0,0 +1,111 @@
+/**
+ * PirTimer
+ * timerbench.cpp
+ * Purpose: Measures how late Timer countdowns fire with many of them overlapping
+ * Dependencies: timer.hpp
+ *
+ * Every round restarts all timers with a random timeout, the way motion keeps
+ * restarting the countdown in pirtimer, optionally while other threads keep
+ * the CPU busy. With -q the countdowns run on one TimerQueue instead of a
+ * thread each; their timeouts are then drawn once, as stages are fixed.
+ *
+ * Usage: ./timerbench [-n timers] [-r rounds] [-m max timeout ms] [-l load threads] [-q]
+*/
+
+#include "timer.hpp"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+  int timers = 200;
+  int rounds = 5;
+  int maxTimeout = 200;
+  int load = 0;
+  bool queue = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:r:m:l:q")) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      timers = std::stoi(optarg);
+      break;
+    case 'r':
+      rounds = std::stoi(optarg);
+      break;
+    case 'm':
+      maxTimeout = std::stoi(optarg);
+      break;
+    case 'l':
+      load = std::stoi(optarg);
+      break;
+    case 'q':
+      queue = true;
+      break;
+    default:
+      std::cerr << "Usage: " << argv[0] << " [-n timers] [-r rounds] [-m max timeout ms] [-l load threads] [-q]" << std::endl;
+      return 1;
+    }
+  }
+
+  std::atomic<bool> done{false};
+  std::vector<std::thread> loaders;
+  for (int i = 0; i < load; i++)
+    loaders.emplace_back([&] {
+      volatile uint64_t spin = 0;
+      while (!done)
+        spin++;
+    });
+
+  TimerStats stats;
+  std::atomic<int> fired{0};
+  std::mt19937 rng(1); // Fixed seed, so runs are comparable
+  std::uniform_int_distribution<int> timeout(1, maxTimeout);
+  if (queue)
+  {
+    TimerQueue countdowns;
+    countdowns.instrument(&stats);
+    std::vector<TimerQueue::Id> ids;
+    for (int i = 0; i < timers; i++)
+      ids.push_back(countdowns.add({{std::chrono::milliseconds(timeout(rng)), [&] { fired++; }}}));
+    for (int round = 0; round < rounds; round++)
+    {
+      for (auto id : ids)
+        countdowns.start(id);
+      std::this_thread::sleep_for(std::chrono::milliseconds(maxTimeout + 50));
+    }
+  }
+  else
+  {
+    std::vector<std::unique_ptr<Timer>> countdowns;
+    for (int i = 0; i < timers; i++)
+    {
+      countdowns.emplace_back(new Timer(std::chrono::milliseconds(0), [&] { fired++; }));
+      countdowns.back()->instrument(&stats);
+    }
+    for (int round = 0; round < rounds; round++)
+    {
+      for (auto &countdown : countdowns)
+        countdown->start(std::chrono::milliseconds(timeout(rng)));
+      std::this_thread::sleep_for(std::chrono::milliseconds(maxTimeout + 50));
+    }
+    for (auto &countdown : countdowns)
+      countdown->stop();
+  }
+
+  done = true;
+  for (auto &loader : loaders)
+    loader.join();
+
+  std::cout << timers << " timers x " << rounds << " rounds, " << load << " load threads" << (queue ? ", one TimerQueue" : "") << std::endl;
+  std::cout << stats.summary().describe() << std::endl;
+  return fired == timers * rounds ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/// Trace points for finding where the time goes between an edge and the packets, e.g.
+///     TRACE_SCOPE("send");      // From here to the end of the block
+///     TRACE_INSTANT("arm");     // A single moment
+/// Every thread writes into its own ring buffer of the last Trace::capacity events, with no
+/// locks, and Trace::json() turns all rings into a Chrome trace (chrome://tracing, Perfetto).
+/// Unless PIRTIMER_TRACE is defined (make pirtimer-trace) the macros compile to nothing.
+class Trace
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// Events kept per thread, older ones are overwritten
+    static constexpr size_t capacity = 4096;
+
+    struct Event
+    {
+        /// A string literal, so only the pointer is stored
+        const char *name;
+        int64_t start;
+        /// Nanoseconds, -1 for an instant
+        int64_t duration;
+    };
+
+    /// Record an event on the calling thread
+    static void record(const char *name, Clock::time_point start, Clock::duration duration)
+    {
+        Ring &ring = local();
+        size_t at = ring.head.load(std::memory_order_relaxed);
+        ring.events[at % capacity] = {name, start.time_since_epoch().count(), duration.count()};
+        ring.head.store(at + 1, std::memory_order_release);
+    }
+
+    /// Records the time from its construction to the end of the scope
+    class Scope
+    {
+    public:
+        explicit Scope(const char *scopeName) : name(scopeName), start(Clock::now()) {}
+        ~Scope() { record(name, start, Clock::now() - start); }
+
+    private:
+        const char *name;
+        Clock::time_point start;
+    };
+
+    /// @return Every thread's events in the Chrome trace event format. Events written while
+    ///         this runs may come out torn, so take it when the daemon is quiet.
+    static std::string json()
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+        bool first = true;
+        std::lock_guard<std::mutex> guard(registry().mx);
+        for (auto &ring : registry().rings)
+        {
+            size_t head = ring->head.load(std::memory_order_acquire);
+            for (size_t i = (head > capacity ? head - capacity : 0); i < head; i++)
+            {
+                const Event &event = ring->events[i % capacity];
+                out << (first ? "" : ",") << "\n{\"name\":\"" << event.name << "\",\"pid\":1,\"tid\":" << ring->thread
+                    << ",\"ts\":" << event.start / 1000.0;
+                if (event.duration < 0)
+                    out << ",\"ph\":\"i\",\"s\":\"t\"}";
+                else
+                    out << ",\"ph\":\"X\",\"dur\":" << event.duration / 1000.0 << "}";
+                first = false;
+            }
+        }
+        out << "\n]}\n";
+        return out.str();
+    }
+
+private:
+    struct Ring
+    {
+        int thread;
+        std::atomic<size_t> head{0};
+        Event events[capacity];
+    };
+
+    /// All rings ever made, kept after their threads end so their events can still be dumped
+    struct Registry
+    {
+        std::mutex mx;
+        std::vector<std::unique_ptr<Ring>> rings;
+        /// Rings whose threads have ended, for the next new thread to write on
+        std::vector<Ring *> unused;
+    };
+
+    /// Hands the thread's ring back when the thread ends, so a thread per animation or
+    /// per packet does not add a ring each: there are only as many as threads at once
+    struct Owner
+    {
+        Ring *ring = nullptr;
+
+        ~Owner()
+        {
+            if (!ring)
+                return;
+            std::lock_guard<std::mutex> guard(registry().mx);
+            registry().unused.push_back(ring);
+        }
+    };
+
+    static Registry &registry()
+    {
+        static Registry r;
+        return r;
+    }
+
+    /// The ring of the calling thread. A reused ring keeps its events and its thread number,
+    /// so in the trace a thread number stands for one thread at a time.
+    static Ring &local()
+    {
+        thread_local Owner owner;
+        if (!owner.ring)
+        {
+            Registry &r = registry();
+            std::lock_guard<std::mutex> guard(r.mx);
+            if (!r.unused.empty())
+            {
+                owner.ring = r.unused.back();
+                r.unused.pop_back();
+            }
+            else
+            {
+                r.rings.emplace_back(new Ring);
+                owner.ring = r.rings.back().get();
+                owner.ring->thread = (int)r.rings.size();
+            }
+        }
+        return *owner.ring;
+    }
+};
+
+#ifdef PIRTIMER_TRACE
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_INSTANT(name) Trace::record(name, Trace::Clock::now(), Trace::Clock::duration(-1))
+#else
+#define TRACE_SCOPE(name) \
+    do                    \
+    {                     \
+    } while (0)
+#define TRACE_INSTANT(name) \
+    do                      \
+    {                       \
+    } while (0)
+#endif